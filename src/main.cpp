@@ -28,71 +28,21 @@
 //Headers
 #include <stdio.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
-
-///////////////////////////////
-//ENUM VALUES FOR INTERPRETER//
-///////////////////////////////
-//Error types
-enum Error
-{
-	NONE = 0,
-	DECL_NON_ID,
-	DECL_ID_NON_ASSIGN,
-	ID_ASSIGN_NON_TERM,
-	ID_ASSIGN_REF_NOT_FOUND,
-	FUNC_MISSING_OPEN_PAREN,
-	FUNC_MISSING_CLOSING_PAREN,
-	FUNC_SCOPE_NO_OPENING,
-	NON_VALID_TOKEN_STATEMENT,
-	OP_ADD_RHS_NOT_ID,
-	ARG_INCORRECT_AMOUNT,
-	ARG_TYPE_MISMATCH,
-	UNKNOWN_ACTION,
-	FUNC_NOT_DECL
-};
-
-//Token types
-enum TokenType
-{
-	PROGRAM = 0,
-	EXPR,
-	DECL,
-	FUNC_CALL,
-	OP,
-	TERM_LIST,
-	FUNC,
-	TERM,
-	CONST,
-	ID,
-	INT,
-	SEP,
-	SEP_OPEN,
-	SEP_CLOSE,
-	SC_OPEN,
-	SC_CLOSE,
-	ASSIGN,
-	COMMA
-};
-
-//Variable types
-enum VarType
-{
-	INTEGER,
-	REFERENCE,
-	FUNCTION
-};
-
-//Types of actions to evaluate
-enum ActionType
-{
-	ADDITION,
-	SUBTRACT,
-	MULTIPLY,
-	DIVISION,
-	FUNCTION_CALL
-};
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+#include "monkey.h"
 
 //////////////////////////////////
 //STRING RESULTS FOR INTERPRETER//
@@ -112,7 +62,12 @@ char* errorStr[] = {
 	"Function was called with an unmatching amount of parameters!",
 	"Function was called with argument(s) of incorrect type!",
 	"Action to evaluate was unknown!",
-	"Function that is attempting to be called was not declared!"
+	"Function that is attempting to be called was not declared!",
+	"Could not open file!",
+	"Could not write snapshot image!",
+	"Snapshot image is invalid or corrupted!",
+	"Profile is invalid or corrupted!",
+	"Snapshot image uses a native function that isn't bound!"
 };
 
 //Token strings
@@ -141,80 +96,81 @@ char* tokenStr[] = {
 char* varStr[] = {
 	"INTEGER",
 	"REFERENCE",
-	"FUNCTION"
+	"FUNCTION",
+	"NATIVE"
 };
 
 //ActionType strings
 char* actStr[] = {
 	"ADDITION",
-	"FUNCTION_CALL"
+	"SUBTRACT",
+	"MULTIPLY",
+	"DIVISION",
+	"FUNCTION_CALL",
+	"NATIVE_CALL",
+	"VALUE",
+	"ASSIGNMENT"
 };
 
 //////////////////////////////////
 //TYPES FOR INTERPRETER LANGUAGE//
 //////////////////////////////////
-//Token struct, for storing type and value
-struct Token
-{
-	//Token's type
-	TokenType type = PROGRAM;
-	//Value of the token
-	std::string value = "";
-};
-
-//Struct for the Int type
-struct Variable
-{
-	VarType type;
-	std::string identifier = "";
-	void* value = NULL;
-};
-
-//Struct for functions
-struct Function
+//Token, variable, function and program types are in monkey.h so embedders can bind natives to programs
+//Struct for the inliner's settings
+struct InlineOptions
 {
-	//Args to copy over as decls
-	std::vector<Variable*> args;
+	//Largest function body, in actions, that gets inlined at a call, 0 turns inlining off
+	int maxActions = 8;
 
-	//The index of the function start token index
-	int scopeStartIndex = -1;
+	//How many inlined bodies deep calls get inlined
+	int maxDepth = 2;
 
-	//Return value for our function
-	int result = 0;
-};
-
-//Struct for actions to evaluate
-struct Action
-{
-	//Type of action to perform
-	ActionType type;
+	//Only inline functions called at least minCalls times in a training run's profile
+	bool profiled = false;
+	int minCalls = 1;
 
-	//Args to use in operation
-	std::vector<Variable*> args;
+	//Call counts of each function's profile id from a training run, by script path
+	std::map<std::string, std::map<int, int>> profiles = std::map<std::string, std::map<int, int>>();
 
-	//Result of action
-	int result = 0;
+	//Path of the script being interpreted, to find its profile
+	std::string script = "";
 
+	//Every function declared so far, nested ones too, to count their calls for a profile
+	std::vector<Function*> functions = std::vector<Function*>();
 };
 
-//Stores scripts tokens/data
-struct Program
-{
-	//Array of tokens, in order, for script
-	std::vector<Token*> tokens = std::vector<Token*>();
+//Inliner settings for the whole interpreter, and how many inlined bodies deep the parser is
+InlineOptions inlineOptions;
+int inlineDepth = 0;
 
-	//Array of variables of different types in function
-	std::vector<Variable*> variables = std::vector<Variable*>();
+//Most function bodies have fewer slots than this, calls to them keep their whole frame on the stack
+const int frameSlots = 16;
 
-	//Array of functions in the program
-	std::vector<Function*> functions = std::vector<Function*>();
+//Struct for the variables of a call, args are the caller's variables and the body's declarations are locals
+//that only live as long as the call
+struct Frame
+{
+	//Variable in each slot of the body
+	Variable** slots = NULL;
+
+	//Variables for the body's declarations, their integers are kept here too so declaring them doesn't allocate
+	Variable* locals = NULL;
+	int* integers = NULL;
+
+	//Storage for bodies with up to frameSlots slots, and for bodies with more
+	Variable* stackSlots[frameSlots];
+	Variable stackLocals[frameSlots];
+	int stackIntegers[frameSlots];
+	std::vector<Variable*> heapSlots = std::vector<Variable*>();
+	std::vector<Variable> heapLocals = std::vector<Variable>();
+	std::vector<int> heapIntegers = std::vector<int>();
+};
 
-	//The array of actions to evaluate
-	std::vector<Action*> actions = std::vector<Action*>();
+//Scripts with fewer bytes than this left to lex are lexed on a single thread
+const int parallelLexMin = 1 << 20;
 
-	//The result of our program
-	int result = 0;
-};
+//Header written at the start of snapshot images
+const char snapshotMagic[] = "MONKIMG4";
 
 //////////////////////////////////
 //UTIL FUNCTIONS FOR INTERPRETER//
@@ -236,19 +192,403 @@ bool CharIsNumber(char c)
 	return true;
 }
 
-//Get a variable that a token is associated with
+//Get the latest declared variable that a token is associated with
 Variable* GetVariable(Program* program, Token token)
 {
-	//Find the variable associated with token value
-	for (int i = 0; i < program->variables.size(); i++)
+	//Find the variable associated with token value, later declarations shadow earlier ones
+	for (int i = program->variables.size() - 1; i >= 0; i--)
 	{
 		if (token.value == program->variables[i]->identifier) return program->variables[i];
 	}
 
+	//Statements of a watched script look in the statements before them, then in what was forked from the prelude
+	if (program->outer != NULL)
+	{
+		std::vector<Statement*>& statements = program->outer->statements;
+		for (int s = program->outerStatement - 1; s >= 0; s--)
+		{
+			std::vector<Variable*>& variables = statements[s]->program->variables;
+			for (int i = variables.size() - 1; i >= 0; i--)
+			{
+				if (token.value == variables[i]->identifier) return variables[i];
+			}
+		}
+		return GetVariable(program->outer, token);
+	}
+
 	//Could not find var
 	return NULL;
 }
 
+//Find the index of the closing bracket for a scope's opening bracket
+int FindScopeClose(Program* program, int index)
+{
+	//Count nested scopes until the one we started in closes
+	int depth = 0;
+	for (int i = index; i < program->tokens.size(); i++)
+	{
+		if (program->tokens[i]->type == SC_OPEN) depth++;
+		else if (program->tokens[i]->type == SC_CLOSE && --depth == 0) return i;
+	}
+
+	//Scope was never closed
+	return program->tokens.size();
+}
+
+//Parse stage, parses function bodies with it when they're declared
+Error ParseProgram(Program* program);
+
+//Eval stage, evaluates function bodies with it when they're called
+Error EvalProgram(Program* program, Variable** frame = NULL);
+
+//Put a variable into a program, variables of function bodies are numbered as the slots of each call's frame
+void AddVariable(Program* program, Variable* var)
+{
+	if (program->frame) var->slot = program->variables.size();
+	program->variables.push_back(var);
+}
+
+//Get the variable an action uses, slots of function bodies are the variables in the call's frame
+Variable* SlotVariable(Variable* var, Variable** frame)
+{
+	if (frame != NULL && var->slot >= 0) return frame[var->slot];
+	return var;
+}
+
+//Make a closure declared in an inlined function body, the slots it captured become the caller's variables
+Closure* BindClosure(Closure* closure, Variable** slots)
+{
+	Closure* bound = new Closure();
+	bound->function = closure->function;
+	for (int j = 0; j < closure->upvalues.size(); j++)
+	{
+		bound->upvalues.push_back(SlotVariable(closure->upvalues[j], slots));
+	}
+	return bound;
+}
+
+//Check if a closure was declared in a function body and hasn't captured a call's variables yet
+bool IsTemplate(Closure* closure)
+{
+	//Its captured variables are still slots of the body it was declared in
+	for (int j = 0; j < closure->upvalues.size(); j++) if (closure->upvalues[j]->slot >= 0) return true;
+	return false;
+}
+
+//Capture the variables of a call for a closure declared in its body, closures that already did are kept as is
+Closure* CaptureClosure(Closure* closure, Variable** frame);
+
+//Copy a variable of a call's frame to one that outlives the call
+Variable* CaptureVariable(Variable* var, Variable** frame)
+{
+	Variable* copy = new Variable();
+	copy->type = var->type;
+	copy->identifier = var->identifier;
+	copy->value = var->value;
+
+	//Integers of declarations are stored in the frame
+	if (var->type == FUNCTION && var->value != NULL)
+	{
+		copy->value = (void*)CaptureClosure((Closure*)var->value, frame);
+	}
+	else if (var->type != NATIVE && var->value != NULL) copy->value = (void*)(new int(*((int*)var->value)));
+	return copy;
+}
+
+Closure* CaptureClosure(Closure* closure, Variable** frame)
+{
+	if (!IsTemplate(closure)) return closure;
+
+	Closure* bound = new Closure();
+	bound->function = closure->function;
+	for (int j = 0; j < closure->upvalues.size(); j++)
+	{
+		Variable* upvalue = closure->upvalues[j];
+		bound->upvalues.push_back(upvalue->slot >= 0 ? CaptureVariable(frame[upvalue->slot], frame) : upvalue);
+	}
+	return bound;
+}
+
+//Parse a function's body once when it's declared, upvalues are the variables a closure of it captured
+void CompileBody(Function* func, std::vector<Variable*>& upvalues)
+{
+	Program* body = new Program();
+	body->frame = true;
+	body->tokenBase = func->program->tokenBase + func->scopeStartIndex + 1;
+
+	//Natives can be called from any function
+	body->natives = func->program->natives;
+
+	//Captured variables come first so the args and the body's declarations shadow them,
+	//their values are only known on a call
+	for (int j = 0; j < upvalues.size(); j++)
+	{
+		Variable* var = new Variable();
+		var->identifier = func->captured[j];
+		var->type = (upvalues[j]->type == FUNCTION || upvalues[j]->type == NATIVE) ? upvalues[j]->type : INTEGER;
+		//Natives are the same for every closure, so calls to them still parse as native calls
+		if (var->type == NATIVE) var->value = upvalues[j]->value;
+
+		//Functions captured where it's declared are too when they already captured their variables, so calls to
+		//them can be inlined, functions from a snapshot that were declared in a body only had one call's captured
+		Closure* captured = var->type == FUNCTION ? (Closure*)upvalues[j]->value : NULL;
+		bool shared = !func->nested || upvalues[j]->slot >= 0;
+		if (captured != NULL && shared && !IsTemplate(captured)) var->value = (void*)captured;
+		AddVariable(body, var);
+	}
+	for (int j = 0; j < func->args.size(); j++)
+	{
+		Variable* var = new Variable();
+		var->type = INTEGER;
+		var->identifier = func->args[j]->identifier;
+		AddVariable(body, var);
+	}
+
+	//Give tokens for function to the body
+	int close = FindScopeClose(func->program, func->scopeStartIndex);
+	for (int index = func->scopeStartIndex + 1; index < close; index++)
+	{
+		body->tokens.push_back(func->program->tokens[index]);
+	}
+
+	func->error = ParseProgram(body);
+	func->body = body;
+}
+
+//Get the body of a closure's function, functions loaded from a snapshot are only parsed once they're first
+//called or inlined, so loading an image doesn't parse the bodies of functions scripts never use
+Program* ClosureBody(Closure* closure)
+{
+	Function* func = closure->function;
+	if (func->body != NULL) return func->body;
+
+	//Calls in the body are inlined from the top, whatever the parser was inlining when it got here
+	int depth = inlineDepth;
+	inlineDepth = 0;
+	CompileBody(func, closure->upvalues);
+	inlineDepth = depth;
+	return func->body;
+}
+
+//Fill in the frame for a call to a closure, outer is the caller's frame, closures called in the frame they were
+//declared in read their captured variables from it
+void MakeFrame(Frame& frame, Closure* closure, Variable** args, Variable** outer)
+{
+	Function* func = closure->function;
+	std::vector<Variable*>& slots = func->body->variables;
+	int size = slots.size();
+
+	//Bodies with more slots than fit on the stack get theirs from the heap
+	frame.slots = frame.stackSlots;
+	frame.locals = frame.stackLocals;
+	frame.integers = frame.stackIntegers;
+	if (size > frameSlots)
+	{
+		frame.heapSlots.resize(size);
+		frame.heapLocals.resize(size);
+		frame.heapIntegers.resize(size);
+		frame.slots = frame.heapSlots.data();
+		frame.locals = frame.heapLocals.data();
+		frame.integers = frame.heapIntegers.data();
+	}
+
+	//Captured variables are shared with where the closure was made
+	int upvalues = closure->upvalues.size();
+	for (int j = 0; j < upvalues; j++)
+	{
+		Variable* var = SlotVariable(closure->upvalues[j], outer);
+
+		//Functions declared in the caller's body would read the callee's frame, so they capture the caller's first
+		bool declared = closure->upvalues[j]->slot >= 0 && var->type == FUNCTION && var->value != NULL;
+		if (declared && IsTemplate((Closure*)var->value)) var = CaptureVariable(var, outer);
+		frame.slots[j] = var;
+	}
+
+	//Args are the caller's variables, their values are never written by the call
+	for (int j = 0; j < func->args.size(); j++) frame.slots[upvalues + j] = args[j];
+
+	//Declarations start as the body's variables, ones declared on evaluation get their integer's storage
+	for (int j = upvalues + func->args.size(); j < size; j++)
+	{
+		Variable* var = &frame.locals[j];
+		var->type = slots[j]->type;
+		var->value = slots[j]->value == NULL ? (void*)&frame.integers[j] : slots[j]->value;
+		frame.slots[j] = var;
+	}
+}
+
+//Declare a variable with an integer, declarations in a call's frame store it in the frame instead of allocating
+void DeclareInteger(Variable* target, int value, bool local)
+{
+	target->type = INTEGER;
+	if (local) *((int*)target->value) = value;
+	else target->value = (void*)(new int(value));
+}
+
+//Check if evaluating an action sets its program's result, value is the variable a VALUE action reads
+bool SetsResult(Action* act, Variable* value)
+{
+	//Declarations never set it, and bare identifiers only do for integers
+	if (act->target != NULL || act->type == ASSIGNMENT) return false;
+	if (act->type == VALUE) return value->value != NULL && value->type != FUNCTION && value->type != NATIVE;
+	return true;
+}
+
+//Replace a call with the actions of its function's body, true if it was inlined
+bool InlineCall(Program* program, Action* act)
+{
+	//Only calls to functions known while parsing can be inlined
+	if (act->type != FUNCTION_CALL || act->callee->type != FUNCTION || act->callee->value == NULL) return false;
+	Closure* closure = (Closure*)act->callee->value;
+	Function* func = closure->function;
+
+	//Stop inlining calls inside of inlined bodies past the max depth
+	if (inlineDepth >= inlineOptions.maxDepth) return false;
+
+	//Only inline hot functions when using a profile
+	if (inlineOptions.profiled)
+	{
+		std::map<int, int>& profile = inlineOptions.profiles[inlineOptions.script];
+		std::map<int, int>::iterator calls = profile.find(func->id);
+		if (calls == profile.end() || calls->second < inlineOptions.minCalls) return false;
+	}
+
+	//Leave calls that fail to evaluate as calls so they report their error
+	Program* body = ClosureBody(closure);
+	if (func->error != NONE || act->args.size() != func->args.size()) return false;
+	//The body was parsed when the function was declared, empty bodies evaluate to 0 instead of the last result
+	if (body->actions.size() == 0 || body->actions.size() > inlineOptions.maxActions) return false;
+
+	//Slots of the body map to the caller's variables, captured ones to the closure's and args to the call's
+	int upvalues = closure->upvalues.size();
+	int params = upvalues + act->args.size();
+	std::vector<Variable*> slots = std::vector<Variable*>(body->variables.size());
+	for (int j = 0; j < upvalues; j++) slots[j] = closure->upvalues[j];
+	for (int j = 0; j < act->args.size(); j++) slots[upvalues + j] = act->args[j];
+
+	//The call evaluates to its body's result, so the last action has to set it, declarations can also take a
+	//function from a bare identifier
+	Action* last = body->actions.back();
+	Variable* value = last->type == VALUE ? last->args[0] : NULL;
+	if (value != NULL && value->slot >= 0 && value->slot < params) value = slots[value->slot];
+	bool declares = act->target != NULL && last->type == VALUE && last->target == NULL;
+	if (!declares && !SetsResult(last, value)) return false;
+
+	//The body's declarations get new variables in the caller, without identifiers so the caller can't look them up
+	for (int j = params; j < slots.size(); j++)
+	{
+		Variable* var = new Variable();
+		var->type = body->variables[j]->type;
+		var->value = body->variables[j]->value;
+		if (var->type == FUNCTION && var->value != NULL)
+		{
+			var->value = (void*)BindClosure((Closure*)var->value, slots.data());
+		}
+		AddVariable(program, var);
+		slots[j] = var;
+	}
+
+	//Put copies of the body's actions in place of the call, inlining the calls in them too
+	inlineDepth++;
+	for (int i = 0; i < body->actions.size(); i++)
+	{
+		Action* copy = new Action(*body->actions[i]);
+		for (int j = 0; j < copy->args.size(); j++) copy->args[j] = SlotVariable(copy->args[j], slots.data());
+		if (copy->callee != NULL) copy->callee = SlotVariable(copy->callee, slots.data());
+		if (copy->target != NULL) copy->target = SlotVariable(copy->target, slots.data());
+		//The last action declares the call's target instead
+		if (i == body->actions.size() - 1) copy->target = act->target;
+
+		if (InlineCall(program, copy)) delete copy;
+		else program->actions.push_back(copy);
+	}
+	inlineDepth--;
+
+	return true;
+}
+
+//Function call handling, index is the token of the called identifier
+Error ParseCall(Program* program, int index, Action*& act)
+{
+	//Make action
+	act = new Action();
+	//Set action type to function
+	act->type = FUNCTION_CALL;
+
+	//Find the function variable to call,
+	//natives bound after a function was declared are found through the program's natives
+	Variable* callee = GetVariable(program, *program->tokens[index]);
+	for (int j = 0; callee == NULL && j < program->natives.size(); j++)
+	{
+		if (program->tokens[index]->value == program->natives[j]->binding->identifier)
+		{
+			callee = program->natives[j]->binding;
+		}
+	}
+
+	//Check that we found function, variables declared by calls only get their type on evaluation
+	if (callee == NULL) return FUNC_NOT_DECL;
+	if (callee->type != FUNCTION && callee->type != NATIVE && callee->value != NULL) return FUNC_NOT_DECL;
+
+	//Find the variables passed as args, their values are read on evaluation
+	for (int j = index + 2; program->tokens[j]->type != SEP_CLOSE; j++)
+	{
+		//Skip the commas between args
+		if (program->tokens[j]->type == COMMA) continue;
+
+		Variable* var = GetVariable(program, *program->tokens[j]);
+		if (var == NULL) return ID_ASSIGN_REF_NOT_FOUND;
+		act->args.push_back(var);
+	}
+
+	//Native calls read their args straight from the caller's variables
+	if (callee->type == NATIVE)
+	{
+		act->type = NATIVE_CALL;
+		act->function = *((int*)callee->value);
+
+		//Natives only take their amount of integers
+		if (act->args.size() != program->natives[act->function]->arity) return ARG_INCORRECT_AMOUNT;
+		for (int j = 0; j < act->args.size(); j++)
+		{
+			if (act->args[j]->type == FUNCTION || act->args[j]->type == NATIVE) return ARG_TYPE_MISMATCH;
+		}
+	}
+	//Closures are read from the variable on evaluation
+	else act->callee = callee;
+
+	return NONE;
+}
+
+//Capture the variables a function's body uses from the program it's declared in
+void CaptureUpvalues(Program* program, Function* func, Closure* closure)
+{
+	//Every identifier in the body, nested functions included,
+	//that isn't an arg and was declared before the function
+	int close = FindScopeClose(program, func->scopeStartIndex);
+	for (int i = func->scopeStartIndex + 1; i < close; i++)
+	{
+		if (program->tokens[i]->type != ID) continue;
+
+		//Args shadow captured variables
+		bool arg = false;
+		for (int j = 0; j < func->args.size() && !arg; j++)
+		{
+			arg = func->args[j]->identifier == program->tokens[i]->value;
+		}
+		if (arg) continue;
+
+		//Capture each variable once
+		Variable* var = GetVariable(program, *program->tokens[i]);
+		if (var == NULL) continue;
+		bool captured = false;
+		for (int j = 0; j < closure->upvalues.size() && !captured; j++) captured = closure->upvalues[j] == var;
+		if (captured) continue;
+		closure->upvalues.push_back(var);
+		func->captured.push_back(program->tokens[i]->value);
+	}
+}
+
 //DECL token goes here, this function checks for creating a variable
 Error MakeVariable(Program* program, int& index)
 {
@@ -279,7 +619,24 @@ Error MakeVariable(Program* program, int& index)
 		//Set the pointer to the data to a new integer's address with the value from the INT token
 		var->value = (void*)(new int(std::stoi(program->tokens[index + 3]->value)));
 		//Put the variable into the program
-		program->variables.push_back(var);
+		AddVariable(program, var);
+	}
+	else if (program->tokens[index + 3]->type == ID && program->tokens[index + 4]->type == SEP_OPEN)
+	{
+		//Set the identifier for the variable to the ID token's value,
+		//it gets its type and value when the call is evaluated
+		var->type = INTEGER;
+		var->identifier = program->tokens[index + 1]->value;
+
+		//Parse the call, declared after so the args can't be the variable itself
+		Action* act = NULL;
+		Error err = ParseCall(program, index + 3, act);
+		if (err != NONE) return err;
+		act->target = var;
+
+		//Put the action, or the function's body when it's small enough to inline, and variable into the program
+		if (inlineOptions.maxActions == 0 || !InlineCall(program, act)) program->actions.push_back(act);
+		AddVariable(program, var);
 	}
 	else if (program->tokens[index + 3]->type == ID)
 	{
@@ -289,21 +646,18 @@ Error MakeVariable(Program* program, int& index)
 		var->identifier = program->tokens[index + 1]->value;
 
 		//Check if variable to reference by identifier was declared before
-		for (int i = 0; i < program->variables.size(); i++)
-		{
-			//Check if this is the correct variable by identifier
-			if (program->tokens[index + 3]->value == program->variables[i]->identifier)
-			{
-				//Set the value to "reference" the other variable by setting it to the same point in memory
-				var->value = program->variables[i]->value;
-			}
-		}
-
-		//Check if reference was found, otherwise return error
-		if (var->value == NULL) return ID_ASSIGN_REF_NOT_FOUND;
-
-		//Put the variable into the program's variable array
-		program->variables.push_back(var);
+		Variable* ref = GetVariable(program, *program->tokens[index + 3]);
+		if (ref == NULL) return ID_ASSIGN_REF_NOT_FOUND;
+
+		//Share the value on evaluation, variables declared by calls and args only get theirs then
+		Action* act = new Action();
+		act->type = ASSIGNMENT;
+		act->args.push_back(ref);
+		act->target = var;
+
+		//Put the action and variable into the program
+		program->actions.push_back(act);
+		AddVariable(program, var);
 	}
 	else if (program->tokens[index + 3]->type == FUNC)
 	{
@@ -314,8 +668,6 @@ Error MakeVariable(Program* program, int& index)
 		var->type = FUNCTION;
 		//Set the identifier for the variable to the ID token's value
 		var->identifier = program->tokens[index + 1]->value;
-		//Set the pointer to the index of the new function in the function array
-		var->value = (void*)(new int(program->functions.size()));
 
 		//Find the functions arguments/parameters identifiers, if there are any
 		std::vector<Variable*> args = std::vector<Variable*>();
@@ -349,11 +701,28 @@ Error MakeVariable(Program* program, int& index)
 		func->args = args;
 		//Set the starting token for the function to the opening bracket
 		func->scopeStartIndex = index + 6 + i;
+		func->program = program;
+		func->nested = program->frame;
+		func->id = program->tokenBase + func->scopeStartIndex;
+		inlineOptions.functions.push_back(func);
+
+		//Make the function's value, capturing the variables its body uses
+		Closure* closure = new Closure();
+		closure->function = func;
+		CaptureUpvalues(program, func, closure);
+		//Set the pointer to the closure
+		var->value = (void*)closure;
+
+		//Parse the body once, calls only bind its slots
+		CompileBody(func, closure->upvalues);
 
 		//Put the function into the program
 		program->functions.push_back(func);
 		//Put the variable into the program
-		program->variables.push_back(var);
+		AddVariable(program, var);
+
+		//Move to the end of the function's body so it isn't parsed as part of the program
+		index = FindScopeClose(program, func->scopeStartIndex);
 	}
 	else //IF we don't find the type, then throw an error
 	{
@@ -367,11 +736,14 @@ Error MakeVariable(Program* program, int& index)
 //////////////////////////////////
 //STAGE FUNCTIONS OF INTERPRETER//
 //////////////////////////////////
-//Lexically analyze a script from the file
-Error LexProgram(std::string script, Program* program)
+//Lexically analyze the bytes of a script between start and end, end must be the end of a top level statement
+void LexRange(const std::string& script, Program* program, int start, int end)
 {
+	//Scope depth, statements only end at the top level
+	int depth = 0;
+
 	//Tokenize the script
-	for (int i = 0; i < script.length(); i++)
+	for (int i = start; i < end; i++)
 	{
 		//Character skips
 		if (script[i] == ' ') continue; //Skip spaces
@@ -441,18 +813,96 @@ Error LexProgram(std::string script, Program* program)
 
 		//Store token
 		program->tokens.push_back(token);
+
+		//Track scopes and checkpoint the end of top level statements
+		if (token->type == SC_OPEN) depth++;
+		else if (token->type == SC_CLOSE) depth--;
+		else if (token->type == SEP && depth == 0)
+		{
+			Checkpoint* cp = new Checkpoint();
+			cp->byte = i + 1;
+			cp->tokens = program->tokens.size();
+			program->checkpoints.push_back(cp);
+		}
+	}
+}
+
+//Lexically analyze a script from the file
+Error LexProgram(const std::string& script, Program* program)
+{
+	//Lex small scripts on this thread
+	int threads = std::thread::hardware_concurrency();
+	if (script.length() < parallelLexMin || threads < 2)
+	{
+		LexRange(script, program, 0, script.length());
+		return NONE;
+	}
+
+	//Pre-scan for top level statement ends to split the script into about one chunk per thread
+	std::vector<int> splits = std::vector<int>();
+	splits.push_back(0);
+	int chunk = script.length() / threads;
+	int depth = 0;
+	for (int i = 0; i < script.length(); i++)
+	{
+		if (script[i] == '{') depth++;
+		else if (script[i] == '}') depth--;
+		else if (script[i] == ';' && depth == 0 && i + 1 - splits.back() >= chunk) splits.push_back(i + 1);
+	}
+	if (splits.back() != script.length()) splits.push_back(script.length());
+
+	//Lex each chunk into its own token buffer, the first on this thread
+	std::vector<Program*> chunks = std::vector<Program*>();
+	std::vector<std::thread> workers = std::vector<std::thread>();
+	for (int i = 0; i + 1 < splits.size(); i++) chunks.push_back(new Program());
+	for (int i = 1; i < chunks.size(); i++)
+	{
+		workers.push_back(std::thread(LexRange, std::cref(script), chunks[i], splits[i], splits[i + 1]));
+	}
+	LexRange(script, chunks[0], splits[0], splits[1]);
+	for (int i = 0; i < workers.size(); i++) workers[i].join();
+
+	//Append the chunks in order, checkpoint token counts are offset by the tokens before the chunk
+	for (int i = 0; i < chunks.size(); i++)
+	{
+		int offset = program->tokens.size();
+		program->tokens.insert(program->tokens.end(), chunks[i]->tokens.begin(), chunks[i]->tokens.end());
+		for (int j = 0; j < chunks[i]->checkpoints.size(); j++)
+		{
+			chunks[i]->checkpoints[j]->tokens += offset;
+			program->checkpoints.push_back(chunks[i]->checkpoints[j]);
+		}
+		delete chunks[i];
 	}
 
 	//Return success
 	return NONE;
 }
 
+//Record how much a program had parsed at a checkpoint
+void ParseCheckpoint(Program* program, Checkpoint* cp)
+{
+	cp->variables = program->variables.size();
+	cp->functions = program->functions.size();
+	cp->actions = program->actions.size();
+}
+
 //Parse through a tokenized script, check for errors
 Error ParseProgram(Program* program)
 {
+	//Find the first checkpoint that hasn't been parsed yet
+	int c = program->checkpoints.size();
+	while (c > 0 && program->checkpoints[c - 1]->variables == -1) c--;
+
 	//Go through and create usable data by parsing the tokens
-	for (int i = 0; i < program->tokens.size(); i++)
+	for (int i = program->tokenStart; i < program->tokens.size(); i++)
 	{
+		//Record the checkpoints of statements we finished
+		while (c < program->checkpoints.size() && program->checkpoints[c]->tokens <= i)
+		{
+			ParseCheckpoint(program, program->checkpoints[c++]);
+		}
+
 		//Make the type of data we can use for evaluation
 		if (program->tokens[i]->type == DECL)
 		{
@@ -466,41 +916,12 @@ Error ParseProgram(Program* program)
 		else if (program->tokens[i]->type == ID && program->tokens[i+1]->type == SEP_OPEN)
 		{
 			//Parse the function call and set it to be done on evaluation
-			//Make action
-			Action* act = new Action();
-			//Set action type to function
-			act->type = FUNCTION_CALL;
-			//Use to see if we find function
-			act->result = -1;
-			//Check if function variable to call by identifier was declared before
-			for (int j = 0; j < program->variables.size(); j++)
-			{
-				//Check if this is the correct variable by identifier
-				if (program->tokens[i]->value == program->variables[j]->identifier)
-				{
-					//Store function location in result
-					act->result = *((int*)program->variables[j]->value);
-				}
-			}
-
-			//Check that we found function
-			if (act->result == -1) return FUNC_NOT_DECL;
-
-			//Make arguments for action
-			for(int j = 0; j < program->functions[act->result]->args.size(); j++)
-			{
-				//Make variable
-				Variable* var = new Variable();
-				//Set variable type
-				var->type = INTEGER;
-				//Set variable's value
-				var->value = GetVariable(program, *program->tokens[((j + 1) * 2) + i])->value;
-				//Put in args
-				act->args.push_back(var);
-			}
+			Action* act = NULL;
+			Error err = ParseCall(program, i, act);
+			if (err != NONE) return err;
 
-			//Put the action in the array
-			program->actions.push_back(act);
+			//Put the action in the array, or the function's body when it's small enough to inline
+			if (inlineOptions.maxActions == 0 || !InlineCall(program, act)) program->actions.push_back(act);
 		}
 		//Operation call handling
 		else if (program->tokens[i]->type == ID && program->tokens[i+1]->type == OP)
@@ -529,30 +950,27 @@ Error ParseProgram(Program* program)
 				act->type = DIVISION;
 			}
 
-			//Push first two variables to add
-			//Check if variable to reference by identifier was declared before
-			for (int j = 0; j < program->variables.size(); j++)
-			{
-				//Check if this is the correct variable by identifier
-				if (program->tokens[i]->value == program->variables[j]->identifier)
-				{
-					act->args.push_back(program->variables[j]);
-				}
-			}
-
-			//Check if second variable to reference by identifier was declared before
-			for (int j = 0; j < program->variables.size(); j++)
-			{
-				//Check if this is the correct variable by identifier
-				if (program->tokens[i+2]->value == program->variables[j]->identifier)
-				{
-					act->args.push_back(program->variables[j]);
-				}
-			}
+			//Push first two variables to add, checking they were declared before
+			Variable* lhs = GetVariable(program, *program->tokens[i]);
+			Variable* rhs = GetVariable(program, *program->tokens[i+2]);
+			if (lhs == NULL || rhs == NULL) return ID_ASSIGN_REF_NOT_FOUND;
+			act->args.push_back(lhs);
+			act->args.push_back(rhs);
 
 			//Add action to array of actions
 			program->actions.push_back(act);
 		}
+		//Bare identifier handling, evaluates to the variable so functions can return it
+		else if (program->tokens[i]->type == ID && program->tokens[i+1]->type == SEP)
+		{
+			Variable* var = GetVariable(program, *program->tokens[i]);
+			if (var == NULL) return ID_ASSIGN_REF_NOT_FOUND;
+
+			Action* act = new Action();
+			act->type = VALUE;
+			act->args.push_back(var);
+			program->actions.push_back(act);
+		}
 		//Skipping section
 		else if (program->tokens[i]->type == SEP) continue;
 		else if (program->tokens[i]->type == SC_CLOSE) continue;
@@ -569,215 +987,1515 @@ Error ParseProgram(Program* program)
 		while (program->tokens[i]->type != SEP) i++;
 	}
 
+	//Record the rest of the checkpoints
+	while (c < program->checkpoints.size()) ParseCheckpoint(program, program->checkpoints[c++]);
+
 	//Return success
 	return NONE;
 }
 
-//Evaluate a parsed and tokenized script
-Error EvalProgram(Program* program)
+//Evaluate a single action, frame has the variables of the call when the program is a function's body
+Error EvalAction(Program* program, Action* act, Variable** frame)
 {
-	//Go through actions in order and do them
-	for (int i = 0; i < program->actions.size(); i++)
+	//Variables the action uses, function bodies use the ones in the call's frame, looked up into a stack buffer
+	Variable** args = act->args.data();
+	Variable* buffer[frameSlots];
+	std::vector<Variable*> spill = std::vector<Variable*>();
+	if (frame != NULL)
 	{
-		if (program->actions[i]->type == ADDITION)
+		args = buffer;
+		if (act->args.size() > frameSlots)
 		{
-			//Set the result back to 0
-			program->actions[i]->result = 0;
-			//Add each arg into result
-			for (int j = 0; j < program->actions[i]->args.size(); j++)
-			{
-				if (program->actions[i]->args[j]->value == NULL) printf("Arg %i is NULL!", j);
-				//printf("Arg %i val: %i\n", j, *((int*)(program->actions[i]->args[j]->value)));
-				program->actions[i]->result += *((int*)(program->actions[i]->args[j]->value));
-			}
-			//Set program result
-			program->result = program->actions[i]->result;
+			spill.resize(act->args.size());
+			args = spill.data();
+		}
+		for (int j = 0; j < act->args.size(); j++) args[j] = SlotVariable(act->args[j], frame);
+	}
+	Variable* target = act->target == NULL ? NULL : SlotVariable(act->target, frame);
+	Variable* callee = act->callee == NULL ? NULL : SlotVariable(act->callee, frame);
+
+	//Operations only work on integers
+	if (act->type == ADDITION || act->type == SUBTRACT || act->type == MULTIPLY || act->type == DIVISION)
+	{
+		for (int j = 0; j < act->args.size(); j++)
+		{
+			if (args[j]->type == FUNCTION || args[j]->type == NATIVE) return ARG_TYPE_MISMATCH;
 		}
-		else if (program->actions[i]->type == SUBTRACT)
+	}
+
+	if (act->type == ADDITION)
+	{
+		//Set the result back to 0
+		act->result = 0;
+		//Add each arg into result
+		for (int j = 0; j < act->args.size(); j++)
 		{
-			//Set the result back to first arg
-			program->actions[i]->result = *((int*)(program->actions[i]->args[0]->value));
-			//Subtract each arg from result
-			for (int j = 1; j < program->actions[i]->args.size(); j++)
-			{
-				if (program->actions[i]->args[j]->value == NULL) printf("Arg %i is NULL!", j);
-				//printf("Arg %i val: %i\n", j, *((int*)(program->actions[i]->args[j]->value)));
-				program->actions[i]->result -= *((int*)(program->actions[i]->args[j]->value));
-			}
-			//Set program result
-			program->result = program->actions[i]->result;
+			if (args[j]->value == NULL) printf("Arg %i is NULL!", j);
+			//printf("Arg %i val: %i\n", j, *((int*)(args[j]->value)));
+			act->result += *((int*)(args[j]->value));
 		}
-		else if (program->actions[i]->type == MULTIPLY)
+		//Declare the target with the result, or set program result
+		if (target != NULL) DeclareInteger(target, act->result, frame != NULL);
+		else program->result = act->result;
+	}
+	else if (act->type == SUBTRACT)
+	{
+		//Set the result back to first arg
+		act->result = *((int*)(args[0]->value));
+		//Subtract each arg from result
+		for (int j = 1; j < act->args.size(); j++)
 		{
-			//Set the result back to first arg
-			program->actions[i]->result = *((int*)(program->actions[i]->args[0]->value));
-			//Multiply each arg into result
-			for (int j = 1; j < program->actions[i]->args.size(); j++)
-			{
-				if (program->actions[i]->args[j]->value == NULL) printf("Arg %i is NULL!", j);
-				//printf("Arg %i val: %i\n", j, *((int*)(program->actions[i]->args[j]->value)));
-				program->actions[i]->result *= *((int*)(program->actions[i]->args[j]->value));
-			}
-			//Set program result
-			program->result = program->actions[i]->result;
+			if (args[j]->value == NULL) printf("Arg %i is NULL!", j);
+			//printf("Arg %i val: %i\n", j, *((int*)(args[j]->value)));
+			act->result -= *((int*)(args[j]->value));
 		}
-		else if (program->actions[i]->type == DIVISION)
+		//Declare the target with the result, or set program result
+		if (target != NULL) DeclareInteger(target, act->result, frame != NULL);
+		else program->result = act->result;
+	}
+	else if (act->type == MULTIPLY)
+	{
+		//Set the result back to first arg
+		act->result = *((int*)(args[0]->value));
+		//Multiply each arg into result
+		for (int j = 1; j < act->args.size(); j++)
 		{
-			//Set the result back to first arg
-			program->actions[i]->result = *((int*)(program->actions[i]->args[0]->value));
-			//Add each arg into result
-			for (int j = 1; j < program->actions[i]->args.size(); j++)
-			{
-				if (program->actions[i]->args[j]->value == NULL) printf("Arg %i is NULL!", j);
-				//printf("Arg %i val: %i\n", j, *((int*)(program->actions[i]->args[j]->value)));
-				program->actions[i]->result /= *((int*)(program->actions[i]->args[j]->value));
-			}
-			//Set program result
-			program->result = program->actions[i]->result;
+			if (args[j]->value == NULL) printf("Arg %i is NULL!", j);
+			//printf("Arg %i val: %i\n", j, *((int*)(args[j]->value)));
+			act->result *= *((int*)(args[j]->value));
 		}
-		else if (program->actions[i]->type == FUNCTION_CALL)
+		//Declare the target with the result, or set program result
+		if (target != NULL) DeclareInteger(target, act->result, frame != NULL);
+		else program->result = act->result;
+	}
+	else if (act->type == DIVISION)
+	{
+		//Set the result back to first arg
+		act->result = *((int*)(args[0]->value));
+		//Add each arg into result
+		for (int j = 1; j < act->args.size(); j++)
+		{
+			if (args[j]->value == NULL) printf("Arg %i is NULL!", j);
+			//printf("Arg %i val: %i\n", j, *((int*)(args[j]->value)));
+			act->result /= *((int*)(args[j]->value));
+		}
+		//Declare the target with the result, or set program result
+		if (target != NULL) DeclareInteger(target, act->result, frame != NULL);
+		else program->result = act->result;
+	}
+	else if (act->type == FUNCTION_CALL && callee->type != NATIVE)
+	{
+		//Get the closure to call, variables declared by calls might not have been a function
+		if (callee->type != FUNCTION || callee->value == NULL) return FUNC_NOT_DECL;
+		Closure* closure = (Closure*)callee->value;
+		Function* func = closure->function;
+		//Count the call for profiling
+		func->calls++;
+		//Set the result back to 0
+		act->result = 0;
+
+		//Make sure we have the same amount of args
+		if (act->args.size() != func->args.size()) return ARG_INCORRECT_AMOUNT;
+
+		//Check for body parse errors, the body was parsed when the function was declared or first used
+		ClosureBody(closure);
+		if (func->error != NONE)
 		{
-			//Get function location from result
-			int func = program->actions[i]->result;
-			//Set the result back to 0
-			program->actions[i]->result = 0;
+			printf("Function parsing error!\n");
+			return func->error;
+		}
 
-			//Make sure we have the same amount of args
-			if (program->actions[i]->args.size() != program->functions[func]->args.size()) return ARG_INCORRECT_AMOUNT;
-			//Check that args match function args, and set function args equal to values of args
-			for (int j = 0; j < program->actions[i]->args.size(); j++)
-			{
-				//Check to make sure args are the same type
-				if (program->actions[i]->args[j]->type != program->functions[func]->args[j]->type) return ARG_TYPE_MISMATCH;
+		//Functions declared in the caller's body leave it as args, so they capture its variables first
+		for (int j = 0; frame != NULL && j < act->args.size(); j++)
+		{
+			bool function = args[j]->type == FUNCTION && args[j]->value != NULL;
+			if (function && IsTemplate((Closure*)args[j]->value)) args[j] = CaptureVariable(args[j], frame);
+		}
 
-				//Set arg equal to other arg value
-				program->functions[func]->args[j]->value = program->actions[i]->args[j]->value;
-			}
+		//Evaluate the body with this call's variables in its slots
+		Frame callFrame;
+		MakeFrame(callFrame, closure, args, frame);
+		Error err = EvalProgram(func->body, callFrame.slots);
 
-			//Make a new sub program for function
-			Program* subprogram = new Program();
-			//Make the variables for function program
-			subprogram->variables = program->functions[func]->args;
-			//Give tokens for function to the function program
-			int index = program->functions[func]->scopeStartIndex + 1;
-			while (program->tokens[index]->type != SC_CLOSE)
-			{
-				subprogram->tokens.push_back(program->tokens[index]);
-				index++;
-			}
+		//Check for body eval errors
+		if (err != 0)
+		{
+			printf("Function evaluation error!\n");
+			return err;
+		}
 
-			//Parse sub program
-			Error err = ParseProgram(subprogram);
+		//Set the result to the body's result
+		act->result = func->body->result;
 
-			//Check for sub program parse errors
-			if (err != 0)
-			{
-				printf("Function parsing error!\n");
-				return err;
-			}
-
-			//Evaluate sub program
-			err = EvalProgram(subprogram);
+		//Functions returned by the call capture its variables before its frame is gone
+		Variable* returned = func->body->returned;
+		bool function = returned != NULL && (returned->type == FUNCTION || returned->type == NATIVE);
+		void* value = function ? returned->value : NULL;
+		if (function && returned->type == FUNCTION) value = (void*)CaptureClosure((Closure*)value, callFrame.slots);
 
-			//Check for sub program eval errors
-			if (err != 0)
+		//Declare the target with the call's result, functions returned by the call are declared as functions
+		if (target != NULL)
+		{
+			if (function)
+			{
+				target->type = returned->type;
+				target->value = value;
+			}
+			else DeclareInteger(target, act->result, frame != NULL);
+		}
+		//Otherwise the program evaluates to the call
+		else
+		{
+			program->result = act->result;
+			program->returned = NULL;
+			if (function)
 			{
-				printf("Function evaluation error!\n");
-				return err;
+				program->returnedCall.type = returned->type;
+				program->returnedCall.value = value;
+				program->returned = &program->returnedCall;
 			}
+		}
+	}
+	else if (act->type == FUNCTION_CALL || act->type == NATIVE_CALL)
+	{
+		//Variables only known to hold a native on evaluation are called the same way
+		Native* native = program->natives[act->type == NATIVE_CALL ? act->function : *((int*)callee->value)];
 
-			//Set the result to the sub program's result
-			program->result = subprogram->result;
+		//Natives only take their amount of integers
+		if (act->args.size() != native->arity) return ARG_INCORRECT_AMOUNT;
+		for (int j = 0; j < act->args.size(); j++)
+		{
+			if (args[j]->type == FUNCTION || args[j]->type == NATIVE) return ARG_TYPE_MISMATCH;
+		}
+
+		//Call straight through the native's thunk
+		act->result = native->thunk(native->func, args);
+		//Declare the target with the result, or set program result
+		if (target != NULL) DeclareInteger(target, act->result, frame != NULL);
+		else program->result = act->result;
+	}
+	else if (act->type == VALUE && target != NULL)
+	{
+		//Inlined bodies declare the call's target with their last variable, like the call returning it
+		Variable* var = args[0];
+		if (var->type == FUNCTION || var->type == NATIVE)
+		{
+			target->type = var->type;
+			target->value = var->value;
 		}
 		else
 		{
-			return UNKNOWN_ACTION;
+			act->result = *((int*)var->value);
+			DeclareInteger(target, act->result, frame != NULL);
+		}
+	}
+	else if (act->type == VALUE)
+	{
+		//Set the variable as what the program evaluated to
+		Variable* var = args[0];
+		program->returned = var;
+		//Integers also set program result
+		if (var->type != FUNCTION && var->type != NATIVE)
+		{
+			act->result = *((int*)var->value);
+			program->result = act->result;
 		}
 	}
+	else if (act->type == ASSIGNMENT)
+	{
+		//Set the value to "reference" the other variable by setting it to the same point in memory
+		Variable* ref = args[0];
+		if (ref->value == NULL) return ID_ASSIGN_REF_NOT_FOUND;
+		target->value = ref->value;
+		//References to functions are functions themselves
+		target->type = (ref->type == FUNCTION || ref->type == NATIVE) ? ref->type : REFERENCE;
+	}
+	else
+	{
+		return UNKNOWN_ACTION;
+	}
+
+	//Return success
+	return NONE;
+}
+
+//Evaluate a parsed and tokenized script,
+//frame has the variables of the call when the program is a function's body
+Error EvalProgram(Program* program, Variable** frame)
+{
+	//Calls start their body without a result
+	if (frame != NULL)
+	{
+		program->result = 0;
+		program->returned = NULL;
+	}
+
+	//Go through actions in order and do them
+	for (int i = 0; i < program->actions.size(); i++)
+	{
+		//Only bare identifiers and calls that return them evaluate to a variable
+		program->returned = NULL;
+
+		Error err = EvalAction(program, program->actions[i], frame);
+		if (err != NONE) return err;
+	}
 
 	//Return success
 	return NONE;
 }
 
+//Write the call counts of every script's functions for profile guided inlining
+Error WriteProfile(const char* path, std::vector<char*>& scripts, std::vector<Program*>& programs)
+{
+	FILE* file = fopen(path, "w");
+	if (file == NULL) return FILE_OPEN_FAILED;
+
+	//Each script's path on its own line, then a line with the profile id and call count of each function it called
+	for (int i = 0; i < programs.size(); i++)
+	{
+		fprintf(file, "script %s\n", scripts[i]);
+		std::map<int, int>& calls = programs[i]->calls;
+		for (std::map<int, int>::iterator it = calls.begin(); it != calls.end(); it++)
+		{
+			fprintf(file, "%i %i\n", it->first, it->second);
+		}
+	}
+
+	fclose(file);
+	return NONE;
+}
+
+//Read a profile written by WriteProfile into the inliner's settings
+Error ReadProfile(const char* path)
+{
+	FILE* file = fopen(path, "r");
+	if (file == NULL) return FILE_OPEN_FAILED;
+
+	//Profile of the script the lines are for
+	std::map<int, int>* profile = NULL;
+	char line[4096];
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		int id, calls;
+		if (strncmp(line, "script ", 7) == 0)
+		{
+			std::string script = line + 7;
+			if (!script.empty() && script.back() == '\n') script.pop_back();
+			profile = &inlineOptions.profiles[script];
+		}
+		else if (profile != NULL && sscanf(line, "%i %i", &id, &calls) == 2 && id >= 0) (*profile)[id] = calls;
+		else
+		{
+			fclose(file);
+			return PROFILE_INVALID;
+		}
+	}
+
+	fclose(file);
+	inlineOptions.profiled = true;
+	return NONE;
+}
+
+//Read the value of a count option, false if it isn't a whole number
+bool ReadCount(const char* arg, int& value)
+{
+	char* end = NULL;
+	long count = strtol(arg, &end, 10);
+	if (end == arg || *end != '\0' || count < 0 || count > 1 << 30) return false;
+	value = count;
+	return true;
+}
+
 //Gets string for given error
 std::string ReportError(Error error)
 {
 	return errorStr[error];
 }
 
-//Main function that takes arguments
-int main(int argc, char* argv[])
+/////////////////////////////////////
+//PRELUDE SNAPSHOTS FOR INTERPRETER//
+/////////////////////////////////////
+//Write an int to a snapshot image
+void WriteInt(FILE* file, int value)
 {
-	//Initialize variable names array
+	fwrite(&value, sizeof(int), 1, file);
+}
 
-	//Interpret all monkey files given to us
-	for (int i = 1; i < argc; i++)
+//Write a length prefixed string to a snapshot image
+void WriteString(FILE* file, std::string value)
+{
+	WriteInt(file, value.length());
+	fwrite(value.c_str(), 1, value.length(), file);
+}
+
+//Read an int from a snapshot image, false if the image ended
+bool ReadInt(FILE* file, int& value)
+{
+	return fread(&value, sizeof(int), 1, file) == 1;
+}
+
+//Read a length prefixed string from a snapshot image, false if the image ended
+bool ReadString(FILE* file, std::string& value)
+{
+	int length;
+	if (!ReadInt(file, length) || length < 0) return false;
+	value.resize(length);
+	return fread(&value[0], 1, length, file) == length;
+}
+
+//Read an entire script file into a string
+Error ReadScript(const char* path, std::string& script)
+{
+	//Open the script as a file
+	FILE* file = fopen(path, "r");
+	if (file == NULL) return FILE_OPEN_FAILED;
+
+	//Get the entire script's text
+	script = "";
+	char c = fgetc(file);
+	while (c != EOF)
 	{
-		//Show the user that we are interpreting their script
-		printf("Interpreting script %i: %s\n", i, argv[i]);
+		script += c;
+		c = fgetc(file);
+	}
 
-		//Create script object, and error object
-		Error error = NONE;
-		Program program;
+	fclose(file);
+	return NONE;
+}
 
-		//Open the script as a file
-		FILE* file = fopen(argv[i], "r");
-		//Get the entire script's text
-		std::string script = "";
-		char c = fgetc(file);
-		while (c != EOF)
+//Write a function as the token its body starts at and its arg identifiers,
+//false if its body isn't in the program's tokens
+bool WriteFunction(FILE* file, Program* program, Function* func)
+{
+	//Functions declared in a call's body have their index into the body's tokens, their id is into the program's
+	int start = func->id;
+	if (start >= program->tokens.size() || program->tokens[start] != func->program->tokens[func->scopeStartIndex])
+	{
+		return false;
+	}
+
+	//Only the arg identifiers are needed since values are set on call
+	WriteInt(file, start);
+	WriteInt(file, func->args.size());
+	for (int j = 0; j < func->args.size(); j++) WriteString(file, func->args[j]->identifier);
+
+	//Identifiers its closures capture, the body reads them by these even when inlining shared a caller's variable
+	WriteInt(file, func->captured.size());
+	for (int j = 0; j < func->captured.size(); j++) WriteString(file, func->captured[j]);
+	return true;
+}
+
+//Write a variable's type, identifier and value,
+//count is how many of the program's variables were written before it
+bool WriteVariable(FILE* file, Program* program, Variable* var, int count);
+
+//Write a closure as its function and the variables it captured
+bool WriteClosure(FILE* file, Program* program, Closure* closure, int count)
+{
+	//Functions declared in the program are stored by index, ones declared in a call's body are stored whole
+	int func = -1;
+	for (int j = 0; j < program->functions.size() && func == -1; j++)
+	{
+		if (program->functions[j] == closure->function) func = j;
+	}
+	WriteInt(file, func);
+	if (func == -1 && !WriteFunction(file, program, closure->function)) return false;
+
+	//Captured variables are stored by index, ones that were a call's variables are stored whole
+	WriteInt(file, closure->upvalues.size());
+	for (int j = 0; j < closure->upvalues.size(); j++)
+	{
+		int upvalue = -1;
+		for (int k = 0; k < count && upvalue == -1; k++)
 		{
-			script += c;
-			c = fgetc(file);
+			if (program->variables[k] == closure->upvalues[j]) upvalue = k;
 		}
+		WriteInt(file, upvalue);
+		if (upvalue == -1 && !WriteVariable(file, program, closure->upvalues[j], count)) return false;
+	}
+	return true;
+}
+
+bool WriteVariable(FILE* file, Program* program, Variable* var, int count)
+{
+	WriteInt(file, var->type);
+	WriteString(file, var->identifier);
+
+	//Natives are bound by the embedder on every run,
+	//store the identifier they were bound as to rebind them on load
+	if (var->type == NATIVE) WriteString(file, program->natives[*((int*)var->value)]->binding->identifier);
+	//Variables declared by calls that never finished have no value
+	else if (var->value == NULL) return false;
+	else if (var->type == FUNCTION) return WriteClosure(file, program, (Closure*)var->value, count);
+	//Integers store their value, references too since values are never written once set
+	else WriteInt(file, *((int*)var->value));
+
+	return true;
+}
+
+//Write the tokens, functions and variables of an evaluated program to an image
+Error WriteSnapshot(const char* path, Program* program)
+{
+	FILE* file = fopen(path, "wb");
+	if (file == NULL) return SNAPSHOT_WRITE_FAILED;
+
+	fwrite(snapshotMagic, 1, sizeof(snapshotMagic), file);
+
+	//Tokens, function bodies are stored as the token ranges they start at
+	WriteInt(file, program->tokens.size());
+	for (int i = 0; i < program->tokens.size(); i++)
+	{
+		WriteInt(file, program->tokens[i]->type);
+		WriteString(file, program->tokens[i]->value);
+	}
+
+	//Functions
+	WriteInt(file, program->functions.size());
+	for (int i = 0; i < program->functions.size(); i++) WriteFunction(file, program, program->functions[i]);
+
+	//Variables
+	WriteInt(file, program->variables.size());
+	for (int i = 0; i < program->variables.size(); i++)
+	{
+		if (!WriteVariable(file, program, program->variables[i], i))
+		{
+			printf("Could not store variable: %s\n", program->variables[i]->identifier.c_str());
+			fclose(file);
+			return SNAPSHOT_WRITE_FAILED;
+		}
+	}
+
+	WriteInt(file, program->result);
+
+	//Check nothing failed while writing
+	bool failed = ferror(file);
+	if (fclose(file) != 0 || failed) return SNAPSHOT_WRITE_FAILED;
+	return NONE;
+}
+
+//Check if bytes read from the start of a file are the snapshot image header
+bool HasSnapshotMagic(const char* magic)
+{
+	return memcmp(magic, snapshotMagic, sizeof(snapshotMagic)) == 0;
+}
+
+//Check if a file starts with the snapshot image header
+bool IsSnapshot(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) return false;
+
+	char magic[sizeof(snapshotMagic)];
+	bool match = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && HasSnapshotMagic(magic);
+	fclose(file);
+	return match;
+}
+
+//Bail out of reading an image on the first read that fails or doesn't make sense
+#define SNAPSHOT_CHECK(cond) if (!(cond)) return SNAPSHOT_INVALID;
+
+//Read a function written by WriteFunction
+Error ReadFunction(FILE* file, Program* program, Function*& func)
+{
+	int args, captured;
+	func = new Function();
+	func->program = program;
+	SNAPSHOT_CHECK(ReadInt(file, func->scopeStartIndex));
+	SNAPSHOT_CHECK(func->scopeStartIndex >= 0 && func->scopeStartIndex < program->tokens.size());
+	func->id = func->scopeStartIndex;
+	inlineOptions.functions.push_back(func);
+	SNAPSHOT_CHECK(program->tokens[func->scopeStartIndex]->type == SC_OPEN);
+	SNAPSHOT_CHECK(ReadInt(file, args) && args >= 0);
+	for (int j = 0; j < args; j++)
+	{
+		Variable* a = new Variable();
+		a->type = INTEGER;
+		SNAPSHOT_CHECK(ReadString(file, a->identifier));
+		func->args.push_back(a);
+	}
+	SNAPSHOT_CHECK(ReadInt(file, captured) && captured >= 0);
+	func->captured.resize(captured);
+	for (int j = 0; j < captured; j++) SNAPSHOT_CHECK(ReadString(file, func->captured[j]));
+	return NONE;
+}
+
+//Read a variable written by WriteVariable, variables are the image's variables read so far
+Error ReadVariable(FILE* file, Program* program, std::vector<Variable*>& variables, Variable*& var);
+
+//Read a closure written by WriteClosure
+Error ReadClosure(FILE* file, Program* program, std::vector<Variable*>& variables, Closure*& closure)
+{
+	int index, count;
+	closure = new Closure();
+
+	//Function by index, or a whole function that was declared in a call's body
+	SNAPSHOT_CHECK(ReadInt(file, index) && index >= -1 && index < (int)program->functions.size());
+	if (index >= 0) closure->function = program->functions[index];
+	else
+	{
+		Error err = ReadFunction(file, program, closure->function);
+		if (err != NONE) return err;
+		closure->function->nested = true;
+	}
+
+	//Captured variables by index, or whole variables that were a call's
+	SNAPSHOT_CHECK(ReadInt(file, count) && count == closure->function->captured.size());
+	for (int j = 0; j < count; j++)
+	{
+		Variable* var = NULL;
+		SNAPSHOT_CHECK(ReadInt(file, index) && index >= -1 && index < (int)variables.size());
+		if (index >= 0) var = variables[index];
+		else
+		{
+			Error err = ReadVariable(file, program, variables, var);
+			if (err != NONE) return err;
+		}
+		closure->upvalues.push_back(var);
+	}
+
+	//The body is parsed when the function is first called or inlined
+	return NONE;
+}
+
+Error ReadVariable(FILE* file, Program* program, std::vector<Variable*>& variables, Variable*& var)
+{
+	int type, value;
+	std::string str;
+	var = new Variable();
+	SNAPSHOT_CHECK(ReadInt(file, type) && type >= INTEGER && type <= NATIVE && ReadString(file, var->identifier));
+	var->type = (VarType)type;
+
+	if (var->type == NATIVE)
+	{
+		//Rebind to the native bound with the same identifier this run
+		SNAPSHOT_CHECK(ReadString(file, str));
+		for (int j = 0; j < program->natives.size() && var->value == NULL; j++)
+		{
+			if (program->natives[j]->binding->identifier == str) var->value = program->natives[j]->binding->value;
+		}
+		if (var->value == NULL) return NATIVE_NOT_BOUND;
+	}
+	else if (var->type == FUNCTION)
+	{
+		Closure* closure = NULL;
+		Error err = ReadClosure(file, program, variables, closure);
+		if (err != NONE) return err;
+		var->value = (void*)closure;
+	}
+	else
+	{
+		SNAPSHOT_CHECK(ReadInt(file, value));
+		var->value = (void*)(new int(value));
+	}
+	return NONE;
+}
+
+//Read an image's tokens, functions and variables into a program
+Error ReadImage(FILE* file, Program* program)
+{
+	//Counts and values read from the image
+	int count, type;
+	char magic[sizeof(snapshotMagic)];
+
+	SNAPSHOT_CHECK(fread(magic, 1, sizeof(magic), file) == sizeof(magic) && HasSnapshotMagic(magic));
+
+	//Tokens
+	SNAPSHOT_CHECK(ReadInt(file, count) && count >= 0);
+	for (int i = 0; i < count; i++)
+	{
+		Token* token = new Token();
+		SNAPSHOT_CHECK(ReadInt(file, type) && type >= PROGRAM && type <= COMMA && ReadString(file, token->value));
+		token->type = (TokenType)type;
+		program->tokens.push_back(token);
+	}
+
+	//Functions
+	SNAPSHOT_CHECK(ReadInt(file, count) && count >= 0);
+	for (int i = 0; i < count; i++)
+	{
+		Function* func = NULL;
+		Error err = ReadFunction(file, program, func);
+		if (err != NONE) return err;
+		program->functions.push_back(func);
+	}
+
+	//Variables, indices in the image are into this array since bindings aren't read into the program twice
+	std::vector<Variable*> variables = std::vector<Variable*>();
+	SNAPSHOT_CHECK(ReadInt(file, count) && count >= 0);
+	for (int i = 0; i < count; i++)
+	{
+		Variable* var = NULL;
+		Error err = ReadVariable(file, program, variables, var);
+		if (err != NONE) return err;
+
+		//The bindings themselves are already in the program, only variables that were assigned a native are new
+		Native* native = var->type == NATIVE ? program->natives[*((int*)var->value)] : NULL;
+		if (native != NULL && native->binding->identifier == var->identifier)
+		{
+			delete var;
+			var = native->binding;
+		}
+		else program->variables.push_back(var);
+		variables.push_back(var);
+	}
+
+	SNAPSHOT_CHECK(ReadInt(file, program->result));
+	return NONE;
+}
+
+#undef SNAPSHOT_CHECK
+
+//Read an image written by WriteSnapshot into a program that only has natives bound
+Error ReadSnapshot(const char* path, Program* program)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) return FILE_OPEN_FAILED;
+
+	Error error = ReadImage(file, program);
+	fclose(file);
+	return error;
+}
+
+//Start a program from the state of an evaluated base program
+//The arrays of tokens, variables and functions are copied, the objects in them are shared with the base since
+//nothing in them is written once evaluated, and new ones are only ever appended to the forked program's arrays
+void ForkProgram(Program* base, Program* program)
+{
+	program->tokens = base->tokens;
+	program->variables = base->variables;
+	program->functions = base->functions;
+	program->natives = base->natives;
+	program->result = base->result;
+
+	//Base actions were already evaluated, only parse new tokens
+	program->tokenStart = program->tokens.size();
+}
+
+//Load a prelude into the base program, either from a snapshot image or by interpreting the script
+bool LoadPrelude(const char* path, Program* program)
+{
+	Error error = NONE;
+
+	//Images are loaded straight into the program
+	if (IsSnapshot(path))
+	{
+		error = ReadSnapshot(path, program);
+		if (error) printf("Snapshot Error: %s\n", ReportError(error).c_str());
+		return error == NONE;
+	}
+
+	//Otherwise lex, parse and evaluate the prelude script
+	std::string script;
+	error = ReadScript(path, script);
+	if (error)
+	{
+		printf("Prelude Error: %s\n", ReportError(error).c_str());
+		return false;
+	}
+
+	error = LexProgram(script, program);
+	if (error)
+	{
+		printf("Lexical Error: %s\n", ReportError(error).c_str());
+		return false;
+	}
+
+	error = ParseProgram(program);
+	if (error)
+	{
+		printf("Parsing Error: %s\n", ReportError(error).c_str());
+		return false;
+	}
+
+	error = EvalProgram(program);
+	if (error)
+	{
+		printf("Evaluation Error: %s\n", ReportError(error).c_str());
+		return false;
+	}
+
+	return true;
+}
+
+//Lex, parse and evaluate a script, and report the result, false if it failed
+bool InterpretScript(const std::string& script, Program* program)
+{
+	//Create error object
+	Error error = NONE;
+
+	//Lexically analyze script
+	error = LexProgram(script, program);
+	if (error)
+	{
+		//Print the error, report the interpretor stopping
+		printf("Lexical Error: %s\n", ReportError(error).c_str());
+		printf("Stopping interpretor for script.\n");
+		return false;
+	}
+	//Print lexed token results
+	/*for (int i = 0; i < program->tokens.size(); i++)
+	{
+		if (program->tokens[i]->type == SEP)           printf("<%s>\n", tokenStr[SEP]);
+		else if (program->tokens[i]->type == SC_OPEN)  printf("\n<%s>\n", tokenStr[SC_OPEN]);
+		else if (program->tokens[i]->type == SC_CLOSE) printf("<%s>\n", tokenStr[SC_CLOSE]);
+		else                                          printf("<%s>", tokenStr[program->tokens[i]->type]);
+	}*/
+
+	//Parse the script
+	error = ParseProgram(program);
+	if (error)
+	{
+		//Print the error, report the interpretor stopping
+		printf("Parsing Error: %s\n", ReportError(error).c_str());
+		printf("Stopping interpretor for script.\n");
+		return false;
+	}
+	//Print list of actions
+	/*for (int i = 0; i < program->actions.size(); i++)
+	{
+		printf("Actions %i type: %s\n", i, actStr[program->actions[i]->type]);
+	}*/
+
+	//Evaluate the script
+	error = EvalProgram(program);
+	if (error)
+	{
+		//Print the error, report the interpretor stopping
+		printf("Evaluation Error: %s\n", ReportError(error).c_str());
+		printf("Stopping interpretor for script.\n");
+		return false;
+	}
+
+	//Print the program result
+	printf("Result => %i\n", program->result);
+	return true;
+}
+
+//Start a program's checkpoints at its current state, so its script's statements can be split from its fork
+void StartCheckpoints(Program* program)
+{
+	Checkpoint* cp = new Checkpoint();
+	cp->tokens = program->tokens.size();
+	ParseCheckpoint(program, cp);
+	program->checkpoints.push_back(cp);
+}
 
-		//Lexically analyze script
-		error = LexProgram(script, &program);
+//Struct for a script in watch mode, a graph of the statements that read each variable lets edits only re-run
+//what they affect
+struct Watch
+{
+	//Path and text of the script, its program and the base program it's forked from
+	char* path = NULL;
+	std::string text = "";
+	Program* program = NULL;
+	Program* base = NULL;
+
+	//Whether the last run failed, the next edit interprets the whole script again
+	bool stale = false;
+
+	//Statements that read each variable, and that have each identifier in their tokens
+	std::map<Variable*, std::vector<Statement*>> readers = std::map<Variable*, std::vector<Statement*>>();
+	std::map<std::string, std::vector<Statement*>> users = std::map<std::string, std::vector<Statement*>>();
+};
+
+//Split a script into its top level statements, each ends right after its ';' like the lexer's checkpoints
+std::vector<std::string> SplitStatements(const std::string& script)
+{
+	std::vector<std::string> statements = std::vector<std::string>();
+	int start = 0;
+	int depth = 0;
+	for (int i = 0; i < script.length(); i++)
+	{
+		if (script[i] == '{') depth++;
+		else if (script[i] == '}') depth--;
+		else if (script[i] == ';' && depth == 0)
+		{
+			statements.push_back(script.substr(start, i + 1 - start));
+			start = i + 1;
+		}
+	}
+
+	//Text after the last statement is kept when there is some
+	if (start < script.length()) statements.push_back(script.substr(start));
+	return statements;
+}
+
+//Add a statement to the watch's graph, by the variables it reads and the identifiers it uses
+void IndexStatement(Watch* watch, Statement* s)
+{
+	Program* program = s->program;
+
+	//Variables read by actions and captured by functions
+	s->reads.clear();
+	for (int i = 0; i < program->actions.size(); i++)
+	{
+		s->reads.insert(s->reads.end(), program->actions[i]->args.begin(), program->actions[i]->args.end());
+		if (program->actions[i]->callee != NULL) s->reads.push_back(program->actions[i]->callee);
+	}
+	for (int i = 0; i < program->variables.size(); i++)
+	{
+		if (program->variables[i]->type != FUNCTION || program->variables[i]->value == NULL) continue;
+		Closure* closure = (Closure*)program->variables[i]->value;
+		s->reads.insert(s->reads.end(), closure->upvalues.begin(), closure->upvalues.end());
+	}
+
+	//A statement's entries are added together, so checking the last one skips repeats
+	for (int i = 0; i < s->reads.size(); i++)
+	{
+		std::vector<Statement*>& readers = watch->readers[s->reads[i]];
+		if (readers.empty() || readers.back() != s) readers.push_back(s);
+	}
+	for (int i = 0; i < program->tokens.size(); i++)
+	{
+		if (program->tokens[i]->type != ID) continue;
+		std::vector<Statement*>& users = watch->users[program->tokens[i]->value];
+		if (users.empty() || users.back() != s) users.push_back(s);
+	}
+}
+
+//Take a statement out of the watch's graph before it's dropped or parsed again
+void UnindexStatement(Watch* watch, Statement* s)
+{
+	for (int i = 0; i < s->reads.size(); i++)
+	{
+		std::vector<Statement*>& readers = watch->readers[s->reads[i]];
+		readers.erase(std::remove(readers.begin(), readers.end(), s), readers.end());
+	}
+	for (int i = 0; i < s->program->tokens.size(); i++)
+	{
+		if (s->program->tokens[i]->type != ID) continue;
+		std::vector<Statement*>& users = watch->users[s->program->tokens[i]->value];
+		users.erase(std::remove(users.begin(), users.end(), s), users.end());
+	}
+	s->reads.clear();
+}
+
+//Split an interpreted program into its statements at its checkpoints, what the script added moves into them
+void SplitProgram(Watch* watch)
+{
+	Program* program = watch->program;
+	std::vector<Checkpoint*>& checkpoints = program->checkpoints;
+
+	//State after the end of the script, for text after the last statement
+	Checkpoint end;
+	end.byte = watch->text.length();
+	end.tokens = program->tokens.size();
+	ParseCheckpoint(program, &end);
+
+	for (int c = 0; c < checkpoints.size(); c++)
+	{
+		Checkpoint* from = checkpoints[c];
+		Checkpoint* to = c + 1 < checkpoints.size() ? checkpoints[c + 1] : &end;
+		if (from->byte == to->byte) continue;
+
+		Statement* s = new Statement();
+		s->text = watch->text.substr(from->byte, to->byte - from->byte);
+		s->index = program->statements.size();
+		s->program = new Program();
+		std::vector<Variable*>& variables = program->variables;
+		std::vector<Function*>& functions = program->functions;
+		s->program->tokens.assign(program->tokens.begin() + from->tokens, program->tokens.begin() + to->tokens);
+		s->program->variables.assign(variables.begin() + from->variables, variables.begin() + to->variables);
+		s->program->functions.assign(functions.begin() + from->functions, functions.begin() + to->functions);
+		s->program->actions.assign(program->actions.begin() + from->actions, program->actions.begin() + to->actions);
+		program->statements.push_back(s);
+		IndexStatement(watch, s);
+	}
+
+	//The program keeps what it forked from the prelude
+	Checkpoint* fork = checkpoints[0];
+	program->tokens.resize(fork->tokens);
+	program->variables.resize(fork->variables);
+	program->functions.resize(fork->functions);
+	program->actions.resize(fork->actions);
+	for (int c = 0; c < checkpoints.size(); c++) delete checkpoints[c];
+	checkpoints.clear();
+}
+
+//Interpret a watched script from the start, used when a reload can't tell what an edit affects
+void RunWatched(Watch* watch)
+{
+	Program* program = new Program();
+	ForkProgram(watch->base, program);
+	StartCheckpoints(program);
+	watch->program = program;
+	watch->readers.clear();
+	watch->users.clear();
+
+	watch->stale = !InterpretScript(watch->text, program);
+	if (!watch->stale) SplitProgram(watch);
+}
+
+//Get the variable each identifier was last declared as by some statements, later statements read those
+std::map<std::string, Variable*> LastDeclarations(std::vector<Statement*>& statements)
+{
+	std::map<std::string, Variable*> declared = std::map<std::string, Variable*>();
+	for (int s = 0; s < statements.size(); s++)
+	{
+		std::vector<Variable*>& variables = statements[s]->program->variables;
+		//Variables inlined bodies declared have no identifier
+		for (int i = 0; i < variables.size(); i++)
+		{
+			if (!variables[i]->identifier.empty()) declared[variables[i]->identifier] = variables[i];
+		}
+	}
+	return declared;
+}
+
+//Get the type of each declared variable, recycling a variable overwrites its type
+std::map<std::string, VarType> DeclaredTypes(std::map<std::string, Variable*>& declared)
+{
+	std::map<std::string, VarType> types = std::map<std::string, VarType>();
+	for (std::map<std::string, Variable*>::iterator it = declared.begin(); it != declared.end(); it++)
+	{
+		types[it->first] = it->second->type;
+	}
+	return types;
+}
+
+//Lex and parse a statement of a watched script on its own, declarations reuse the recycled variable with the
+//same identifier
+bool ParseStatement(Watch* watch, Statement* s, std::map<std::string, Variable*>& recycled)
+{
+	//Its lookups continue in the statements before it
+	Program* program = new Program();
+	program->natives = watch->program->natives;
+	program->outer = watch->program;
+	program->outerStatement = s->index;
+	s->program = program;
+
+	//Number its tokens after the ones before it, so its functions get the profile ids they'd have in the script
+	program->tokenBase = watch->program->tokens.size();
+	for (int i = 0; i < s->index; i++) program->tokenBase += watch->program->statements[i]->program->tokens.size();
+
+	LexRange(s->text, program, 0, s->text.length());
+	for (int c = 0; c < program->checkpoints.size(); c++) delete program->checkpoints[c];
+	program->checkpoints.clear();
+
+	Error error = ParseProgram(program);
+	if (error)
+	{
+		//Print the error, report the interpretor stopping
+		printf("Parsing Error: %s\n", ReportError(error).c_str());
+		printf("Stopping interpretor for script.\n");
+		return false;
+	}
+
+	//Swap in the recycled variables so statements that read them are still bound to them
+	for (int i = 0; i < program->variables.size(); i++)
+	{
+		Variable* var = program->variables[i];
+		std::map<std::string, Variable*>::iterator it = recycled.find(var->identifier);
+		if (var->identifier.empty() || it == recycled.end()) continue;
+
+		Variable* old = it->second;
+		recycled.erase(it);
+		old->type = var->type;
+		old->value = var->value;
+		program->variables[i] = old;
+		for (int j = 0; j < program->actions.size(); j++)
+		{
+			Action* act = program->actions[j];
+			std::replace(act->args.begin(), act->args.end(), var, old);
+			if (act->callee == var) act->callee = old;
+			if (act->target == var) act->target = old;
+		}
+		delete var;
+	}
+
+	IndexStatement(watch, s);
+	return true;
+}
+
+//Check if a variable's type is one that calls are parsed for
+bool IsCallable(VarType type)
+{
+	return type == FUNCTION || type == NATIVE;
+}
+
+//Find the identifiers a re-parse changed, ones declared as a different variable or as a function or native
+//before or after, calls to them were parsed and inlined for what they were, so statements using them are parsed
+//again
+void ChangedNames(std::map<std::string, Variable*>& before, std::map<std::string, VarType>& types,
+	std::map<std::string, Variable*>& after, std::set<std::string>& changed)
+{
+	for (std::map<std::string, Variable*>::iterator it = before.begin(); it != before.end(); it++)
+	{
+		std::map<std::string, Variable*>::iterator now = after.find(it->first);
+		if (now == after.end() || now->second != it->second)
+		{
+			changed.insert(it->first);
+		}
+		else if (IsCallable(types[it->first]) || IsCallable(now->second->type))
+		{
+			changed.insert(it->first);
+		}
+	}
+	for (std::map<std::string, Variable*>::iterator it = after.begin(); it != after.end(); it++)
+	{
+		if (before.find(it->first) == before.end()) changed.insert(it->first);
+	}
+}
+
+//Queue the statements from start on that use a changed identifier
+void QueueUsers(Watch* watch, std::set<std::string>& changed, int start, std::set<int>& queue)
+{
+	for (std::set<std::string>::iterator it = changed.begin(); it != changed.end(); it++)
+	{
+		std::vector<Statement*>& users = watch->users[*it];
+		for (int i = 0; i < users.size(); i++) if (users[i]->index >= start) queue.insert(users[i]->index);
+	}
+}
+
+//Evaluate a statement again, queueing the later statements that read a variable it changed
+Error EvalStatement(Watch* watch, Statement* s, bool parsed, std::set<int>& dirty)
+{
+	Program* program = s->program;
+
+	//Declared variables before evaluating, values are never written once set so comparing them finds changes
+	std::vector<VarType> types = std::vector<VarType>();
+	std::vector<void*> values = std::vector<void*>();
+	for (int i = 0; i < program->variables.size(); i++)
+	{
+		types.push_back(program->variables[i]->type);
+		values.push_back(program->variables[i]->value);
+	}
+
+	for (int i = 0; i < program->actions.size(); i++)
+	{
+		//Only bare identifiers and calls that return them evaluate to a variable
+		watch->program->returned = NULL;
+
+		Error err = EvalAction(watch->program, program->actions[i], NULL);
+		if (err != NONE) return err;
+	}
+
+	//Statements parsed again changed all of theirs, functions can change by what they captured
+	for (int i = 0; i < program->variables.size(); i++)
+	{
+		Variable* var = program->variables[i];
+		bool integers = !IsCallable(var->type) && !IsCallable(types[i]) && var->value != NULL && values[i] != NULL;
+		bool same = var->type == types[i] && var->value == values[i];
+		if (var->type == types[i] && integers) same = same || *((int*)var->value) == *((int*)values[i]);
+		if (!parsed && var->type != FUNCTION && same) continue;
+
+		std::vector<Statement*>& readers = watch->readers[var];
+		for (int j = 0; j < readers.size(); j++) if (readers[j]->index > s->index) dirty.insert(readers[j]->index);
+	}
+
+	return NONE;
+}
+
+//Re-run a watched script after an edit, only the statements it changed and the ones reading what they changed
+//are parsed or evaluated again
+void ReloadScript(Watch* watch, const std::string& script)
+{
+	watch->text = script;
+
+	//A failed run left nothing to compare with, interpret the whole script
+	if (watch->stale)
+	{
+		RunWatched(watch);
+		return;
+	}
+
+	std::vector<Statement*>& statements = watch->program->statements;
+	std::vector<std::string> texts = SplitStatements(script);
+
+	//Count the unchanged statements before and after the edit
+	int prefix = 0;
+	while (prefix < statements.size() && prefix < texts.size() && statements[prefix]->text == texts[prefix])
+	{
+		prefix++;
+	}
+	int suffix = 0;
+	while (suffix < statements.size() - prefix && suffix < texts.size() - prefix)
+	{
+		if (statements[statements.size() - 1 - suffix]->text != texts[texts.size() - 1 - suffix]) break;
+		suffix++;
+	}
+
+	//Take out the edited statements, new statements reuse the variables they declared with the same identifiers
+	std::vector<Statement*>::iterator end = statements.end() - suffix;
+	std::vector<Statement*> edited = std::vector<Statement*>(statements.begin() + prefix, end);
+	std::vector<Statement*> after = std::vector<Statement*>(end, statements.end());
+	std::map<std::string, Variable*> before = LastDeclarations(edited);
+	std::map<std::string, VarType> types = DeclaredTypes(before);
+	std::map<std::string, Variable*> recycled = before;
+	for (int i = 0; i < edited.size(); i++) UnindexStatement(watch, edited[i]);
+	statements.resize(prefix);
+
+	//Statements to evaluate again, by index
+	std::set<int> dirty = std::set<int>();
+
+	//Lex and parse the new statements
+	for (int i = prefix; i < texts.size() - suffix; i++)
+	{
+		Statement* s = new Statement();
+		s->text = texts[i];
+		s->index = i;
+		statements.push_back(s);
+		dirty.insert(i);
+		if (!ParseStatement(watch, s, recycled))
+		{
+			watch->stale = true;
+			return;
+		}
+	}
+	std::vector<Statement*> added = std::vector<Statement*>(statements.begin() + prefix, statements.end());
+	std::map<std::string, Variable*> now = LastDeclarations(added);
+
+	//Put the statements after the edit back in their new places
+	for (int i = 0; i < after.size(); i++)
+	{
+		after[i]->index = statements.size();
+		statements.push_back(after[i]);
+	}
+
+	//Parse the later statements that use an identifier the edit changed, which can change more identifiers
+	std::set<std::string> changed = std::set<std::string>();
+	std::set<int> reparse = std::set<int>();
+	ChangedNames(before, types, now, changed);
+	QueueUsers(watch, changed, prefix + added.size(), reparse);
+	while (!reparse.empty())
+	{
+		Statement* s = statements[*reparse.begin()];
+		reparse.erase(reparse.begin());
+		dirty.insert(s->index);
+
+		std::vector<Statement*> one = std::vector<Statement*>(1, s);
+		before = LastDeclarations(one);
+		types = DeclaredTypes(before);
+		recycled = before;
+
+		UnindexStatement(watch, s);
+		if (!ParseStatement(watch, s, recycled))
+		{
+			watch->stale = true;
+			return;
+		}
+
+		now = LastDeclarations(one);
+		changed.clear();
+		ChangedNames(before, types, now, changed);
+		QueueUsers(watch, changed, s->index + 1, reparse);
+	}
+
+	//Evaluate the statements whose inputs changed in order, each can change the inputs of later ones
+	std::set<int> parsed = dirty;
+	while (!dirty.empty())
+	{
+		int i = *dirty.begin();
+		dirty.erase(dirty.begin());
+
+		Error error = EvalStatement(watch, statements[i], parsed.count(i) > 0, dirty);
 		if (error)
 		{
 			//Print the error, report the interpretor stopping
-			printf("Lexical Error: %s\n", ReportError(error).c_str());
+			printf("Evaluation Error: %s\n", ReportError(error).c_str());
 			printf("Stopping interpretor for script.\n");
-			//Skip script, advance loop
+			watch->stale = true;
+			return;
+		}
+	}
+
+	//The program evaluates to its last action that sets a result, or the prelude's when none do
+	Program* program = watch->program;
+	program->result = watch->base->result;
+	bool found = false;
+	for (int s = statements.size() - 1; s >= 0 && !found; s--)
+	{
+		std::vector<Action*>& actions = statements[s]->program->actions;
+		for (int i = actions.size() - 1; i >= 0 && !found; i--)
+		{
+			found = SetsResult(actions[i], actions[i]->type == VALUE ? actions[i]->args[0] : NULL);
+			if (found) program->result = actions[i]->result;
+		}
+	}
+
+	//Print the program result
+	printf("Result => %i\n", program->result);
+}
+
+#ifdef __linux__
+//Watch the scripts for changes and re-run them as they are saved
+void WatchScripts(std::vector<Watch*>& watched)
+{
+	int fd = inotify_init();
+	if (fd == -1)
+	{
+		printf("Watch Error: Could not start inotify!\n");
+		return;
+	}
+
+	//Directory watch for each script, editors often replace files instead of writing them
+	std::vector<int> watches = std::vector<int>();
+	int count = 0;
+	for (int i = 0; i < watched.size(); i++)
+	{
+		std::string path = watched[i]->path;
+		size_t slash = path.find_last_of('/');
+		std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+		watches.push_back(inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO));
+		if (watches[i] != -1)
+		{
+			count++;
 			continue;
 		}
-		//Print lexed token results
-		/*for (int i = 0; i < program.tokens.size(); i++)
+		printf("Watch Error: Could not watch %s for script %i: %s\n", dir.c_str(), i + 1, strerror(errno));
+	}
+
+	//Nothing would ever wake us up
+	if (count == 0)
+	{
+		printf("Watch Error: No scripts could be watched!\n");
+		close(fd);
+		return;
+	}
+
+	printf("Watching %i script(s) for changes.\n", count);
+
+	//Wait on events and re-run the scripts they are for
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	while (true)
+	{
+		int length = read(fd, buffer, sizeof(buffer));
+		if (length <= 0) break;
+
+		char* ptr = buffer;
+		while (ptr < buffer + length)
 		{
-			if (program.tokens[i]->type == SEP)           printf("<%s>\n", tokenStr[SEP]);
-			else if (program.tokens[i]->type == SC_OPEN)  printf("\n<%s>\n", tokenStr[SC_OPEN]);
-			else if (program.tokens[i]->type == SC_CLOSE) printf("<%s>\n", tokenStr[SC_CLOSE]);
-			else                                          printf("<%s>", tokenStr[program.tokens[i]->type]);
-		}*/
+			struct inotify_event* event = (struct inotify_event*)ptr;
+			ptr += sizeof(struct inotify_event) + event->len;
+			if (event->len == 0) continue;
+
+			for (int i = 0; i < watched.size(); i++)
+			{
+				//Match the event's file name to the script's
+				std::string path = watched[i]->path;
+				size_t slash = path.find_last_of('/');
+				std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+				if (watches[i] == -1 || event->wd != watches[i] || name != event->name) continue;
+
+				//Skip saves that didn't change anything
+				std::string script = "";
+				if (ReadScript(watched[i]->path, script) != NONE || script == watched[i]->text) continue;
+
+				printf("Reinterpreting script %i: %s\n", i + 1, watched[i]->path);
+				inlineOptions.script = watched[i]->path;
+				ReloadScript(watched[i], script);
+			}
+		}
+	}
 
-		//Parse the script
-		error = ParseProgram(&program);
+	close(fd);
+}
+#endif
+
+//Interpret scripts with the monkey command's arguments, see monkey.h
+int Interpret(int argc, char* argv[], void (*bind)(Program* base))
+{
+	//Prelude script/image to start every script from, and image to snapshot the prelude to
+	char* preludePath = NULL;
+	char* snapshotPath = NULL;
+	//Profile to write call counts to, or read them from for inlining
+	char* profileGenPath = NULL;
+	char* profileUsePath = NULL;
+	//Re-run scripts as they change
+	bool watch = false;
+	//Print how long each script took to interpret
+	bool timed = false;
+	//Inliner limits, read once every option is sorted
+	char* inlineSize = NULL;
+	char* inlineDepthArg = NULL;
+	//Scripts to interpret, their text, their programs and whether they interpreted without errors
+	std::vector<char*> scripts = std::vector<char*>();
+	std::vector<std::string> texts = std::vector<std::string>();
+	std::vector<Program*> programs = std::vector<Program*>();
+	std::vector<bool> interpreted = std::vector<bool>();
+
+	//Sort arguments into options and scripts
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--prelude") == 0 && i + 1 < argc)           preludePath = argv[++i];
+		else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc)     snapshotPath = argv[++i];
+		else if (strcmp(argv[i], "--watch") == 0)                        watch = true;
+		else if (strcmp(argv[i], "--time") == 0)                         timed = true;
+		else if (strcmp(argv[i], "--inline-size") == 0 && i + 1 < argc)  inlineSize = argv[++i];
+		else if (strcmp(argv[i], "--inline-depth") == 0 && i + 1 < argc) inlineDepthArg = argv[++i];
+		else if (strcmp(argv[i], "--profile-gen") == 0 && i + 1 < argc)  profileGenPath = argv[++i];
+		else if (strcmp(argv[i], "--profile-use") == 0 && i + 1 < argc)  profileUsePath = argv[++i];
+		else                                                             scripts.push_back(argv[i]);
+	}
+
+	//Inliner limits have to be whole numbers
+	if (inlineSize != NULL && !ReadCount(inlineSize, inlineOptions.maxActions))
+	{
+		printf("Option Error: --inline-size and --inline-depth take a whole number!\n");
+		return 1;
+	}
+	if (inlineDepthArg != NULL && !ReadCount(inlineDepthArg, inlineOptions.maxDepth))
+	{
+		printf("Option Error: --inline-size and --inline-depth take a whole number!\n");
+		return 1;
+	}
+
+	//Training runs count every call, so nothing gets inlined
+	if (profileGenPath != NULL) inlineOptions.maxActions = 0;
+
+	//Load the call counts of a training run
+	if (profileUsePath != NULL)
+	{
+		Error error = ReadProfile(profileUsePath);
 		if (error)
 		{
-			//Print the error, report the interpretor stopping
-			printf("Parsing Error: %s\n", ReportError(error).c_str());
-			printf("Stopping interpretor for script.\n");
-			//Skip script, advance loop
-			continue;
+			printf("Profile Error: %s\n", ReportError(error).c_str());
+			return 1;
 		}
-		//Print list of actions
-		/*for (int i = 0; i < program.actions.size(); i++)
+	}
+
+	//Program every script is forked from, holds the prelude's global scope
+	Program base;
+
+	//Bind the embedder's natives first, the prelude can call them and snapshots rebind them by identifier
+	if (bind != NULL) bind(&base);
+
+	//Interpret or load the prelude once
+	if (preludePath != NULL && !LoadPrelude(preludePath, &base))
+	{
+		printf("Stopping interpretor, prelude failed to load.\n");
+		return 1;
+	}
+
+	//Write the prelude's state out for later runs
+	if (snapshotPath != NULL)
+	{
+		Error error = WriteSnapshot(snapshotPath, &base);
+		if (error)
 		{
-			printf("Actions %i type: %s\n", i, actStr[program.actions[i]->type]);
-		}*/
+			printf("Snapshot Error: %s\n", ReportError(error).c_str());
+			return 1;
+		}
+		printf("Wrote snapshot: %s\n", snapshotPath);
+	}
+
+	//Interpret all monkey files given to us
+	for (int i = 0; i < scripts.size(); i++)
+	{
+		//Show the user that we are interpreting their script
+		printf("Interpreting script %i: %s\n", i + 1, scripts[i]);
 
-		//Evaluate the script
-		error = EvalProgram(&program);
+		//Create script object, and error object
+		Error error = NONE;
+		Program* program = new Program();
+		programs.push_back(program);
+
+		//Start from the prelude's global scope
+		ForkProgram(&base, program);
+		StartCheckpoints(program);
+
+		//Get the entire script's text
+		texts.push_back("");
+		interpreted.push_back(false);
+		std::string& script = texts[i];
+		error = ReadScript(scripts[i], script);
 		if (error)
 		{
 			//Print the error, report the interpretor stopping
-			printf("Evaluation Error: %s\n", ReportError(error).c_str());
+			printf("File Error: %s\n", ReportError(error).c_str());
 			printf("Stopping interpretor for script.\n");
 			//Skip script, advance loop
 			continue;
 		}
 
-		//Print the program result
-		printf("Result => %i\n", program.result);
+		//Interpret the script
+		inlineOptions.script = scripts[i];
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		//Count calls from the fork on, the prelude and earlier scripts already called the shared functions
+		std::vector<Function*>& functions = inlineOptions.functions;
+		std::vector<int> forked = std::vector<int>();
+		for (int j = 0; j < functions.size(); j++) forked.push_back(functions[j]->calls);
+		interpreted[i] = InterpretScript(script, program);
+		for (int j = 0; j < functions.size(); j++)
+		{
+			int calls = functions[j]->calls - (j < forked.size() ? forked[j] : 0);
+			if (calls > 0) program->calls[functions[j]->id] += calls;
+		}
+
+		//Print how long the script took
+		if (timed)
+		{
+			auto elapsed = std::chrono::steady_clock::now() - start;
+			long long us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+			printf("Time => %lli us\n", us);
+		}
+	}
+
+	//Write the call counts of the training run
+	if (profileGenPath != NULL)
+	{
+		Error error = WriteProfile(profileGenPath, scripts, programs);
+		if (error) printf("Profile Error: %s\n", ReportError(error).c_str());
+		else       printf("Wrote profile: %s\n", profileGenPath);
 	}
+
+	//Keep re-running the scripts as they change
+	if (watch)
+	{
+#ifdef __linux__
+		//Split each script into its statements, ones that failed are interpreted again when they are saved
+		std::vector<Watch*> watched = std::vector<Watch*>();
+		for (int i = 0; i < scripts.size(); i++)
+		{
+			Watch* w = new Watch();
+			w->path = scripts[i];
+			w->text = texts[i];
+			w->program = programs[i];
+			w->base = &base;
+			w->stale = !interpreted[i];
+			if (interpreted[i]) SplitProgram(w);
+			watched.push_back(w);
+		}
+		WatchScripts(watched);
+#else
+		printf("Watch mode is only supported on Linux.\n");
+#endif
+	}
+
+	return 0;
+}
+
+//Natives every script can call when run by the monkey command
+int NativeMin(int a, int b)
+{
+	return a < b ? a : b;
+}
+
+int NativeMax(int a, int b)
+{
+	return a > b ? a : b;
+}
+
+int NativeMod(int a, int b)
+{
+	//Modulo by zero evaluates to zero instead of crashing
+	if (b == 0) return 0;
+	return a % b;
+}
+
+//Bind the monkey command's natives to the base program
+void BindNatives(Program* base)
+{
+	Bind(base, "min", &NativeMin);
+	Bind(base, "max", &NativeMax);
+	Bind(base, "mod", &NativeMod);
+}
+
+//Embedders define MONKEY_NO_MAIN and call Interpret with their own natives
+#ifndef MONKEY_NO_MAIN
+//Main function that takes arguments
+int main(int argc, char* argv[])
+{
+	return Interpret(argc, argv, &BindNatives);
 }
+#endif
@@ -0,0 +1,343 @@
+//Andrew Legg, 5-5-2020
+//Types and natives binding for embedding the interpreter, src/main.cpp has the grammar specs and stages
+
+#ifndef MONKEY_H
+#define MONKEY_H
+
+//Headers
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+///////////////////////////////
+//ENUM VALUES FOR INTERPRETER//
+///////////////////////////////
+//Error types
+enum Error
+{
+	NONE = 0,
+	DECL_NON_ID,
+	DECL_ID_NON_ASSIGN,
+	ID_ASSIGN_NON_TERM,
+	ID_ASSIGN_REF_NOT_FOUND,
+	FUNC_MISSING_OPEN_PAREN,
+	FUNC_MISSING_CLOSING_PAREN,
+	FUNC_SCOPE_NO_OPENING,
+	NON_VALID_TOKEN_STATEMENT,
+	OP_ADD_RHS_NOT_ID,
+	ARG_INCORRECT_AMOUNT,
+	ARG_TYPE_MISMATCH,
+	UNKNOWN_ACTION,
+	FUNC_NOT_DECL,
+	FILE_OPEN_FAILED,
+	SNAPSHOT_WRITE_FAILED,
+	SNAPSHOT_INVALID,
+	PROFILE_INVALID,
+	NATIVE_NOT_BOUND
+};
+
+//Token types
+enum TokenType
+{
+	PROGRAM = 0,
+	EXPR,
+	DECL,
+	FUNC_CALL,
+	OP,
+	TERM_LIST,
+	FUNC,
+	TERM,
+	CONST,
+	ID,
+	INT,
+	SEP,
+	SEP_OPEN,
+	SEP_CLOSE,
+	SC_OPEN,
+	SC_CLOSE,
+	ASSIGN,
+	COMMA
+};
+
+//Variable types
+enum VarType
+{
+	INTEGER,
+	REFERENCE,
+	FUNCTION,
+	NATIVE
+};
+
+//Types of actions to evaluate
+enum ActionType
+{
+	ADDITION,
+	SUBTRACT,
+	MULTIPLY,
+	DIVISION,
+	FUNCTION_CALL,
+	NATIVE_CALL,
+	VALUE,
+	ASSIGNMENT
+};
+
+//////////////////////////////////
+//TYPES FOR INTERPRETER LANGUAGE//
+//////////////////////////////////
+//Token struct, for storing type and value
+struct Token
+{
+	//Token's type
+	TokenType type = PROGRAM;
+	//Value of the token
+	std::string value = "";
+};
+
+//Struct for the Int type
+struct Variable
+{
+	VarType type;
+	std::string identifier = "";
+	void* value = NULL;
+	//Slot of the variable in a call's frame when it belongs to a function body, -1 otherwise
+	int slot = -1;
+};
+
+//Programs are declared below, functions point back to the program they were declared in
+struct Program;
+
+//Struct for functions
+struct Function
+{
+	//Args to copy over as decls
+	std::vector<Variable*> args;
+
+	//Identifiers of the variables its closures capture, in the order of their upvalues
+	std::vector<std::string> captured = std::vector<std::string>();
+
+	//The index of the function start token index
+	int scopeStartIndex = -1;
+
+	//Program the function was declared in, scopeStartIndex is into its tokens
+	Program* program = NULL;
+
+	//Whether the function was declared in a function body, its closures can then capture different variables
+	bool nested = false;
+
+	//Body parsed once when the function is declared, its variables are the slots of each call's frame
+	Program* body = NULL;
+
+	//Error parsing the body, reported when the function is called
+	Error error = NONE;
+
+	//Return value for our function
+	int result = 0;
+
+	//Times the function was called, for profile guided inlining
+	int calls = 0;
+
+	//Id of the function in profiles, the index of the token its body starts at in the script's tokens, which start
+	//with the prelude's
+	int id = -1;
+};
+
+//Struct for function values, a function and the variables it captured where it was declared
+struct Closure
+{
+	//Function to call
+	Function* function = NULL;
+
+	//Flat array of the captured variables, they fill the first slots of every call's frame
+	std::vector<Variable*> upvalues = std::vector<Variable*>();
+};
+
+//Generic function pointer type that natives are stored as
+typedef void (*NativeFn)();
+
+//Thunk that unpacks args and calls a native function
+typedef int (*NativeThunk)(NativeFn func, Variable** args);
+
+//Struct for C++ functions bound to a program by the embedder
+struct Native
+{
+	//Function to call, cast back to its real type by the thunk
+	NativeFn func = NULL;
+
+	//Thunk generated for the function's signature
+	NativeThunk thunk = NULL;
+
+	//Amount of args the function takes
+	int arity = 0;
+
+	//Variable the native is bound to
+	Variable* binding = NULL;
+};
+
+//Struct for actions to evaluate
+struct Action
+{
+	//Type of action to perform
+	ActionType type;
+
+	//Args to use in operation
+	std::vector<Variable*> args;
+
+	//Index of the native to call
+	int function = -1;
+
+	//Variable holding the closure to call
+	Variable* callee = NULL;
+
+	//Variable declared with the call's result, if the call was a declaration
+	Variable* target = NULL;
+
+	//Result of action
+	int result = 0;
+
+};
+
+//Struct for the state of a program after a top level statement, lets watch mode split a script into statements
+struct Checkpoint
+{
+	//Byte in the script right after the statement
+	int byte = 0;
+
+	//Amount of tokens, variables, functions and actions the program had after the statement, variables is -1
+	//until parsed
+	int tokens = 0;
+	int variables = -1;
+	int functions = 0;
+	int actions = 0;
+};
+
+//Struct for a top level statement of a watched script, edits only re-run the statements they affect
+struct Statement
+{
+	//Text of the statement, compared to find the statements an edit changed
+	std::string text = "";
+
+	//Program holding the tokens, variables, functions and actions parsing the statement made
+	Program* program = NULL;
+
+	//Variables the statement's actions read and its functions captured
+	std::vector<Variable*> reads = std::vector<Variable*>();
+
+	//Position in the watched program's statements
+	int index = 0;
+};
+
+//Stores scripts tokens/data
+struct Program
+{
+	//Array of tokens, in order, for script
+	std::vector<Token*> tokens = std::vector<Token*>();
+
+	//Array of variables of different types in function
+	std::vector<Variable*> variables = std::vector<Variable*>();
+
+	//Array of functions in the program
+	std::vector<Function*> functions = std::vector<Function*>();
+
+	//Array of native functions bound to the program
+	std::vector<Native*> natives = std::vector<Native*>();
+
+	//The array of actions to evaluate
+	std::vector<Action*> actions = std::vector<Action*>();
+
+	//The result of our program
+	int result = 0;
+
+	//Variable the last action evaluated to, set when it was a bare identifier so functions can return functions
+	Variable* returned = NULL;
+
+	//Function the last action's call returned, returned points at it since the call's frame is gone by then
+	Variable returnedCall;
+
+	//Index of the first token to parse, tokens before it were forked from a prelude
+	int tokenStart = 0;
+
+	//Whether the program is a function's body, its variables are then slots filled in for each call
+	bool frame = false;
+
+	//Index of a function body's first token in the tokens of the top level program it was declared in
+	int tokenBase = 0;
+
+	//Top level statement checkpoints, in script order
+	std::vector<Checkpoint*> checkpoints = std::vector<Checkpoint*>();
+
+	//Top level statements of a watched script, they hold what the script added once it's split into them
+	std::vector<Statement*> statements = std::vector<Statement*>();
+
+	//Watched program a statement is parsed for, lookups continue in its statements before outerStatement
+	Program* outer = NULL;
+	int outerStatement = 0;
+
+	//Times each function was called by this program's script by profile id, the prelude's functions are shared
+	//with every script
+	std::map<int, int> calls = std::map<int, int>();
+};
+
+/////////////////////////////////////
+//NATIVE FUNCTIONS FOR INTERPRETER//
+/////////////////////////////////////
+//Compile time check that every arg of a native is an int
+template<typename... Args> struct NativeArgsValid;
+template<> struct NativeArgsValid<>
+{
+	static const bool value = true;
+};
+template<typename T, typename... Rest> struct NativeArgsValid<T, Rest...>
+{
+	static const bool value = std::is_same<T, int>::value && NativeArgsValid<Rest...>::value;
+};
+
+//Call a native with its args unpacked from the action's variables
+template<typename R, typename... Args, size_t... I>
+int CallNative(R (*func)(Args...), Variable** args, std::index_sequence<I...>)
+{
+	return func(*((int*)args[I]->value)...);
+}
+
+//Thunk generated for each native signature
+template<typename R, typename... Args>
+int NativeThunkFor(NativeFn func, Variable** args)
+{
+	return CallNative((R (*)(Args...))func, args, std::index_sequence_for<Args...>());
+}
+
+//Bind a C++ function to a program so scripts can call it by identifier, e.g. Bind(&base, "fx_rate", &fx_rate)
+template<typename R, typename... Args>
+void Bind(Program* program, std::string identifier, R (*func)(Args...))
+{
+	static_assert(NativeArgsValid<Args...>::value, "Native functions can only take int args!");
+	static_assert(std::is_convertible<R, int>::value, "Native functions must return an int!");
+
+	//Make the native with a thunk for its signature
+	Native* native = new Native();
+	native->func = (NativeFn)func;
+	native->thunk = &NativeThunkFor<R, Args...>;
+	native->arity = sizeof...(Args);
+
+	//Make the variable to call it through
+	Variable* var = new Variable();
+	var->type = NATIVE;
+	var->identifier = identifier;
+	var->value = (void*)(new int(program->natives.size()));
+	native->binding = var;
+
+	//Put the native and variable into the program
+	program->natives.push_back(native);
+	program->variables.push_back(var);
+}
+
+///////////////////////////////
+//ENTRY POINT FOR INTERPRETER//
+///////////////////////////////
+//Interpret scripts with the same arguments as the monkey command, bind is called with the base program before
+//the prelude loads so the prelude and every script can call the natives it binds, e.g. Bind(base, "fx", &fx)
+int Interpret(int argc, char* argv[], void (*bind)(Program* base));
+
+#endif